@@ -78,6 +78,8 @@ LABEL_START:			; <--- 从这里开始 *************
 	jc	.MemChkFail
 	add	di, 20
 	inc	dword [_dwMCRNumber]	; dwMCRNumber = ARDS 的个数
+	cmp	dword [_dwMCRNumber], MEM_CHK_BUF_ENTRIES
+	jae	.MemChkOK		; _MemChkBuf 已满
 	cmp	ebx, 0
 	jne	.MemChkLoop
 	jmp	.MemChkOK
@@ -335,6 +337,13 @@ LABEL_PM_START:
 	shl	eax, 4
 	add	eax, KERNEL_FILE_OFF
 	mov	[BOOT_PARAM_ADDR + 8], eax			; BootParam[2] = KernelFilePhyAddr;
+	mov	ecx, [dwMCRNumber]				;
+	mov	[BOOT_PARAM_ADDR + 12], ecx			; BootParam[3] = MCRNumber;
+	mov	esi, MemChkBuf					;
+	mov	edi, BOOT_PARAM_ADDR + 16			; BootParam[4..] = MemChkBuf[];
+	imul	ecx, 5						;
+	cld							;
+	rep	movsd						;
 
 	;***************************************************************
 	jmp	SelectorFlatC:KRNL_ENT_PT_PHY_ADDR	; 正式进入内核 *
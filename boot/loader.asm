@@ -62,6 +62,8 @@ LABEL_START:			; <--- 从这里开始 *************
 	jc	.MemChkFail
 	add	di, 20
 	inc	dword [_dwMCRNumber]	; dwMCRNumber = ARDS 的个数
+	cmp	dword [_dwMCRNumber], MEM_CHK_BUF_ENTRIES
+	jae	.MemChkOK		; _MemChkBuf 已满
 	cmp	ebx, 0
 	jne	.MemChkLoop
 	jmp	.MemChkOK
@@ -433,6 +435,13 @@ LABEL_PM_START:
 	shl	eax, 4
 	add	eax, KERNEL_FILE_OFF
 	mov	[BOOT_PARAM_ADDR + 8], eax ; phy-addr of kernel.bin
+	mov	ecx, [dwMCRNumber]
+	mov	[BOOT_PARAM_ADDR + 12], ecx ; nr of ARDS
+	mov	esi, MemChkBuf
+	mov	edi, BOOT_PARAM_ADDR + 16 ; ARDS[], 5 dwords each
+	imul	ecx, 5
+	cld
+	rep	movsd
 
 	;***************************************************************
 	jmp	SelectorFlatC:KRNL_ENT_PT_PHY_ADDR	; 正式进入内核 *
@@ -133,12 +133,8 @@ int main(int argc, char *argv[])
 
 static int is_executable(const char *path)
 {
-	struct stat info;
 	char magic[4];
 
-	if (stat(path, &info) != 0)
-		return 0;
-
 	int fd = open(path, O_RDWR);
 	if (fd == -1)
 		return 0;
@@ -209,13 +205,7 @@ static void write_content(const char *filename)
 		position = MAX_OFFSET;
 	fill_file_to_position(fd, position);
 
-	if (lseek(fd, position, SEEK_SET) == -1) {
-		printf("Failed to seek to position.\n");
-		close(fd);
-		return;
-	}
-
-	int bytes_written = write(fd, content, content_len);
+	int bytes_written = pwrite(fd, content, content_len, position);
 	if (bytes_written == -1) {
 		printf("Failed to write to file.\n");
 	} else {
@@ -273,28 +263,13 @@ static void delete_content(const char *filename)
 		return;
 	}
 
-	char buffer[BUFFER_SIZE];
+	/* move the tail down inside FS */
 	int read_pos = (int)cursor_offset;
-	while (1) {
-		if (lseek(fd, read_pos, SEEK_SET) == -1) {
-			printf("Failed to seek while deleting.\n");
-			close(fd);
-			return;
-		}
-		int bytes_read = read(fd, buffer, BUFFER_SIZE);
-		if (bytes_read <= 0)
-			break;
-		if (lseek(fd, read_pos - delete_count, SEEK_SET) == -1) {
-			printf("Failed to reposition during delete.\n");
-			close(fd);
-			return;
-		}
-		if (write(fd, buffer, bytes_read) != bytes_read) {
-			printf("Failed to shift file content.\n");
-			close(fd);
-			return;
-		}
-		read_pos += bytes_read;
+	int tail = current_file_size - read_pos;
+	if (copy_range(fd, read_pos, fd, read_pos - delete_count, tail) != tail) {
+		printf("Failed to shift file content.\n");
+		close(fd);
+		return;
 	}
 
 	if (ftruncate(fd, current_file_size - delete_count) == -1) {
@@ -0,0 +1,33 @@
+#include "stdio.h"
+#include "string.h"
+
+#define KB(x) ((x) / 1024)
+
+int main(void)
+{
+	struct mem_stat st;
+	int i;
+
+	if (memstat(&st) != 0) {
+		printf("free: syscall failed\n");
+		return 1;
+	}
+
+	printf("TOTAL(KB) USED(KB) FREE(KB)\n");
+	printf("%d %d %d\n", KB(st.total), KB(st.used), KB(st.total - st.used));
+
+	printf("\nBASE SIZE(KB) OWNER NAME\n");
+	for (i = 0; i < st.nr_regions; i++) {
+		struct mem_info *mi = &st.regions[i];
+		if (mi->owner < 0)
+			printf("0x%x %d - %s\n", mi->base, KB(mi->size), mi->name);
+		else
+			printf("0x%x %d %d %s\n",
+			       mi->base, KB(mi->size), mi->owner, mi->name);
+	}
+
+	printf("\nBUFFER CACHE: HITS MISSES WRITE-BACKS\n");
+	printf("              %d %d %d\n", st.bc_hits, st.bc_misses, st.bc_writes);
+
+	return 0;
+}
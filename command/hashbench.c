@@ -0,0 +1,52 @@
+#include "stdio.h"
+#include "string.h"
+#include "const.h"
+#include "hash.h"
+
+#define BENCH_BUF	(16 * 1024)
+#define BENCH_ROUNDS	256		/* 4MB through each function */
+
+static u8 buf[BENCH_BUF + 1];
+
+static void bench(const struct hash_alg *alg, const u8 *p, const char *what)
+{
+	HASH_CTX ctx;
+	u8 key[HASH_MAX_KEY];
+	u8 digest[HASH_MAX_DIGEST];
+	int i;
+
+	memset(key, 0x5a, sizeof(key));
+
+	int t = get_ticks();
+	hash_init(&ctx, alg, key, 4, 16);
+	for (i = 0; i < BENCH_ROUNDS; i++)
+		hash_update(&ctx, p, BENCH_BUF);
+	hash_final(&ctx, digest);
+	int ticks = get_ticks() - t;
+
+	int kb = BENCH_BUF / 1024 * BENCH_ROUNDS;
+	if (ticks <= 0)
+		ticks = 1;
+	printf("%s %s %d %d\n", alg->name, what, ticks * 1000 / HZ,
+	       kb * HZ / ticks);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *names[] = { "hmac-md5", "blake2s" };
+	int i;
+
+	for (i = 0; i < BENCH_BUF + 1; i++)
+		buf[i] = (u8)i;
+
+	printf("NAME BUFFER MS KB/S\n");
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		const struct hash_alg *alg = hash_find(names[i]);
+		if (argc > 1 && strcmp(argv[1], names[i]) != 0)
+			continue;
+		bench(alg, buf, "aligned");
+		bench(alg, buf + 1, "unaligned");
+	}
+
+	return 0;
+}
@@ -4,7 +4,6 @@
 #include "fs.h"
 
 static void normalize_path(const char *input, char *output);
-static void build_child_path(const char *dir, const char *name, char *out);
 static void list_directory(const char *path);
 static void list_file(const char *path, const char *label, const struct stat *info);
 static void handle_target(const char *target, int show_header);
@@ -56,16 +55,10 @@ static void handle_target(const char *target, int show_header)
 
 static void list_directory(const char *path)
 {
-	struct stat dir_info;
 	int fd;
-	int bytes_read = 0;
-	int total = 0;
-	struct dir_entry entry;
-
-	if (stat(path, &dir_info) != 0) {
-		report_error(path, "stat failed");
-		return;
-	}
+	int n;
+	int i;
+	static struct dirent entries[32];
 
 	fd = open(path, O_RDWR);
 	if (fd < 0) {
@@ -75,33 +68,23 @@ static void list_directory(const char *path)
 
 	print_table_header();
 
-	total = dir_info.st_size;
-	while (bytes_read < total) {
-		int n;
-		memset(&entry, 0, sizeof(entry));
-		n = read(fd, &entry, sizeof(entry));
-		if (n != sizeof(entry))
-			break;
-		bytes_read += n;
-		entry.name[MAX_FILENAME_LEN - 1] = 0;
-		if (entry.inode_nr == 0)
-			continue;
-		if (entry.name[0] == 0)
-			continue;
-		if (entry.name[0] == '.' && entry.name[1] == 0)
-			continue;
-
-		{
-			char child_path[MAX_PATH];
-			struct stat child_info;
-
-			build_child_path(path, entry.name, child_path);
-			if (stat(child_path, &child_info) == 0)
-				print_entry(entry.name, &child_info);
-			else
-				printf("? - - %s\n", entry.name);
+	while ((n = readdir(fd, entries, 32)) > 0) {
+		for (i = 0; i < n; i++) {
+			struct dirent *entry = &entries[i];
+
+			if (entry->d_name[0] == 0)
+				continue;
+			if (entry->d_name[0] == '.' && entry->d_name[1] == 0)
+				continue;
+			if (entry->d_name[0] == '.' && entry->d_name[1] == '.' &&
+			    entry->d_name[2] == 0)
+				continue;
+
+			print_entry(entry->d_name, &entry->d_st);
 		}
 	}
+	if (n < 0)
+		report_error(path, "not a directory");
 
 	close(fd);
 }
@@ -140,22 +123,6 @@ static void normalize_path(const char *input, char *output)
 		output[i - 1] = 0;
 }
 
-static void build_child_path(const char *dir, const char *name, char *out)
-{
-	int len;
-
-	if (!dir || dir[0] == 0 || (dir[0] == '/' && dir[1] == 0)) {
-		sprintf(out, "/%s", name);
-		return;
-	}
-
-	len = strlen(dir);
-	if (dir[len - 1] == '/')
-		sprintf(out, "%s%s", dir, name);
-	else
-		sprintf(out, "%s/%s", dir, name);
-}
-
 static char mode_to_char(int mode)
 {
 	switch (mode & I_TYPE_MASK) {
@@ -0,0 +1,64 @@
+#include "stdio.h"
+#include "string.h"
+#include "const.h"
+
+static void normalize_path(const char *input, char *output);
+static int make_dir(const char *user_path);
+
+int main(int argc, char *argv[])
+{
+	int i;
+	int rc = 0;
+
+	if (argc < 2) {
+		printf("Usage: mkdir <dir> [dir ...]\n");
+		return 1;
+	}
+
+	for (i = 1; i < argc; i++) {
+		if (make_dir(argv[i]) != 0)
+			rc = 1;
+	}
+
+	return rc;
+}
+
+static int make_dir(const char *user_path)
+{
+	char path[MAX_PATH];
+
+	if (!user_path || !*user_path) {
+		printf("mkdir: invalid name\n");
+		return -1;
+	}
+
+	normalize_path(user_path, path);
+
+	if (mkdir(path) != 0) {
+		printf("mkdir: cannot create %s\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+static void normalize_path(const char *input, char *output)
+{
+	const char *src = input;
+	int i = 0;
+
+	if (!input || !*input) {
+		output[0] = '/';
+		output[1] = 0;
+		return;
+	}
+
+	if (*src != '/')
+		output[i++] = '/';
+
+	while (*src && i < MAX_PATH - 1)
+		output[i++] = *src++;
+	output[i] = 0;
+
+	if (i > 1 && output[i - 1] == '/')
+		output[i - 1] = 0;
+}
@@ -59,14 +59,14 @@ static int remove_one(const char *arg, int force)
 		return -1;
 	}
 
-	if ((info.st_mode & I_TYPE_MASK) == I_DIRECTORY) {
-		printf("rm: %s is a directory (flat fs)\n", path);
-		return -1;
-	}
-
 	if (unlink(path) != 0) {
-		if (!force)
-			printf("rm: cannot remove %s\n", path);
+		if (!force) {
+			if ((info.st_mode & I_TYPE_MASK) == I_DIRECTORY)
+				printf("rm: cannot remove %s (not empty?)\n",
+				       path);
+			else
+				printf("rm: cannot remove %s\n", path);
+		}
 		return -1;
 	}
 
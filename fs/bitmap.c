@@ -0,0 +1,429 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   bitmap.c
+ * @brief  Inode-map and sector-map of the root device, kept in memory.
+ *
+ * load_bitmaps() reads both maps into fsmapbuf at mount time. After that
+ * they are searched and changed in memory only, 32 bits at a time. Changed
+ * sectors are marked dirty and handed to the buffer cache by
+ * sync_bitmaps().
+ *
+ * smap_free[] counts the free bits of every smap sector, so that full
+ * sectors are skipped without being looked at.
+ *
+ * Bit `b' of the sector-map stands for sector `n_1st_sect + b'. Outside of
+ * this file, data sectors are dealt with through alloc_sects(),
+ * extend_sects() and free_sects(), which take sector nrs.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+#define	BITS_PER_SECT	(SECTOR_SIZE * 8)
+#define	WORDS_PER_SECT	(SECTOR_SIZE / 4)
+
+PRIVATE int	map_dev = NO_DEV;
+PRIVATE int	nr_imap_sects;
+PRIVATE int	nr_smap_sects;
+PRIVATE int	first_sect;	/**< n_1st_sect of the super block */
+PRIVATE int	nr_data_bits;	/**< bits which stand for real sectors */
+PRIVATE u32 *	imap;		/**< in fsmapbuf */
+PRIVATE u32 *	smap;		/**< in fsmapbuf, right after imap */
+PRIVATE int	smap_free[MAX_SMAP_SECTS];
+PRIVATE u8	imap_dirty[MAX_IMAP_SECTS];
+PRIVATE u8	smap_dirty[MAX_SMAP_SECTS];
+
+PRIVATE int	bsf(u32 x);
+PRIVATE int	count_zero_bits(u32 x);
+PRIVATE void	change_smap_bits(int bit, int n, int set);
+
+/*****************************************************************************
+ *                                load_bitmaps
+ *****************************************************************************/
+/**
+ * <Ring 1> Read the inode-map and the sector-map of the device into memory.
+ *
+ * @param dev  The device. Its super block must have been read.
+ *****************************************************************************/
+PUBLIC void load_bitmaps(int dev)
+{
+	int i, j;
+	struct super_block * sb = get_super_block(dev);
+
+	nr_imap_sects = sb->nr_imap_sects;
+	nr_smap_sects = sb->nr_smap_sects;
+	if (nr_imap_sects > MAX_IMAP_SECTS || nr_smap_sects > MAX_SMAP_SECTS ||
+	    (nr_imap_sects + nr_smap_sects) * SECTOR_SIZE > FSMAPBUF_SIZE)
+		panic("imap/smap too large: %d/%d sectors",
+		      nr_imap_sects, nr_smap_sects);
+
+	map_dev = dev;
+	first_sect = sb->n_1st_sect;
+	nr_data_bits = min(sb->nr_sects - sb->n_1st_sect,
+			   nr_smap_sects * BITS_PER_SECT);
+	imap = (u32*)fsmapbuf;
+	smap = (u32*)(fsmapbuf + nr_imap_sects * SECTOR_SIZE);
+
+	int imap_blk0_nr = 1 + 1; /* 1 boot sector & 1 super block */
+	for (i = 0; i < nr_imap_sects; i++) {
+		RD_SECT(dev, imap_blk0_nr + i);
+		memcpy((u8*)imap + i * SECTOR_SIZE, fsbuf, SECTOR_SIZE);
+		imap_dirty[i] = 0;
+	}
+
+	int smap_blk0_nr = imap_blk0_nr + nr_imap_sects;
+	for (i = 0; i < nr_smap_sects; i++) {
+		RD_SECT(dev, smap_blk0_nr + i);
+		memcpy((u8*)smap + i * SECTOR_SIZE, fsbuf, SECTOR_SIZE);
+		smap_dirty[i] = 0;
+
+		smap_free[i] = 0;
+		u32 * w = &smap[i * WORDS_PER_SECT];
+		for (j = 0; j < WORDS_PER_SECT; j++)
+			smap_free[i] += count_zero_bits(w[j]);
+	}
+}
+
+/*****************************************************************************
+ *                                sync_bitmaps
+ *****************************************************************************/
+/**
+ * <Ring 1> Write the dirty sectors of the maps into the buffer cache.
+ *
+ *****************************************************************************/
+PUBLIC void sync_bitmaps()
+{
+	int i;
+
+	if (map_dev == NO_DEV)
+		return;
+
+	for (i = 0; i < nr_imap_sects; i++) {
+		if (!imap_dirty[i])
+			continue;
+		memcpy(fsbuf, (u8*)imap + i * SECTOR_SIZE, SECTOR_SIZE);
+		WR_SECT(map_dev, 1 + 1 + i);
+		imap_dirty[i] = 0;
+	}
+	for (i = 0; i < nr_smap_sects; i++) {
+		if (!smap_dirty[i])
+			continue;
+		memcpy(fsbuf, (u8*)smap + i * SECTOR_SIZE, SECTOR_SIZE);
+		WR_SECT(map_dev, 1 + 1 + nr_imap_sects + i);
+		smap_dirty[i] = 0;
+	}
+}
+
+/*****************************************************************************
+ *                                alloc_imap_bit
+ *****************************************************************************/
+/**
+ * Allocate a bit in inode-map.
+ *
+ * @param dev  In which device the inode-map is located.
+ *
+ * @return  I-node nr.
+ *****************************************************************************/
+PUBLIC int alloc_imap_bit(int dev)
+{
+	int i;
+	int nr_words = nr_imap_sects * WORDS_PER_SECT;
+
+	assert(dev == map_dev);
+
+	for (i = 0; i < nr_words; i++) {
+		if (imap[i] == 0xFFFFFFFF)
+			continue;
+		int k = bsf(~imap[i]);
+		imap[i] |= 1u << k;
+		imap_dirty[i / WORDS_PER_SECT] = 1;
+		return i * 32 + k;
+	}
+
+	/* no free bit in imap */
+	panic("inode-map is probably full.\n");
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                free_imap_bit
+ *****************************************************************************/
+/**
+ * Free a bit in inode-map.
+ *
+ * @param dev       In which device the inode-map is located.
+ * @param inode_nr  I-node nr.
+ *****************************************************************************/
+PUBLIC void free_imap_bit(int dev, int inode_nr)
+{
+	assert(dev == map_dev);
+	if (inode_nr / BITS_PER_SECT >= nr_imap_sects)
+		panic("free_imap_bit: invalid inode\n");
+
+	u32 * w = &imap[inode_nr / 32];
+	assert(*w & (1u << (inode_nr % 32)));
+	*w &= ~(1u << (inode_nr % 32));
+	imap_dirty[inode_nr / BITS_PER_SECT] = 1;
+}
+
+/*****************************************************************************
+ *                                find_free_run
+ *****************************************************************************/
+/**
+ * Find `n' consecutive free bits in sector-map.
+ *
+ * @param dev  In which device the sector-map is located.
+ * @param n    How many bits.
+ *
+ * @return  The 1st bit of the run plus one, or 0 if there is no such run.
+ *****************************************************************************/
+PUBLIC int find_free_run(int dev, int n)
+{
+	int run_start = 0;
+	int run_len = 0;
+	int i = 0;
+	int nr_words = nr_smap_sects * WORDS_PER_SECT;
+
+	assert(dev == map_dev && n > 0);
+
+	while (i < nr_words) {
+		if (i % WORDS_PER_SECT == 0 && smap_free[i / WORDS_PER_SECT] == 0) {
+			/* the whole sector is used */
+			run_len = 0;
+			i += WORDS_PER_SECT;
+			continue;
+		}
+
+		u32 x = smap[i];
+		if (x == 0xFFFFFFFF) {
+			run_len = 0;
+		}
+		else if (x == 0) {
+			if (run_len == 0)
+				run_start = i * 32;
+			run_len += 32;
+			if (run_len >= n)
+				break;
+		}
+		else {
+			int b = 0;
+			while (b < 32) {
+				if (run_len == 0) {
+					/* skip to the next free bit */
+					b += bsf(~(x >> b));
+					if (b >= 32)
+						break;
+					run_start = i * 32 + b;
+				}
+				/* how many free bits from b on */
+				u32 rest = x >> b;
+				int z = rest ? bsf(rest) : 32 - b;
+				run_len += z;
+				if (run_len >= n)
+					break;
+				b += z;
+				if (b < 32)
+					run_len = 0; /* hit a used bit */
+			}
+			if (run_len >= n)
+				break;
+		}
+		i++;
+	}
+
+	/* runs are found in order, so if this one is past the end, all are */
+	if (run_len < n || run_start + n > nr_data_bits)
+		return 0;
+	return run_start + 1;
+}
+
+/*****************************************************************************
+ *                                alloc_sects
+ *****************************************************************************/
+/**
+ * Allocate contiguous data sectors. If there isn't a free run as long as
+ * asked, fall back to shorter ones.
+ *
+ * @param[in]     dev  In which device the sector-map is located.
+ * @param[in,out] nr   How many sectors are wanted / have been allocated.
+ *
+ * @return  The 1st sector nr allocated, or 0 if the disk is full.
+ *****************************************************************************/
+PUBLIC int alloc_sects(int dev, int * nr)
+{
+	int attempt = max(*nr, 1);
+
+	while (attempt >= 1) {
+		int run_start_bit = find_free_run(dev, attempt);
+		if (run_start_bit > 0) {
+			set_smap_bits(dev, run_start_bit - 1, attempt);
+			*nr = attempt;
+			return (run_start_bit - 1) + first_sect;
+		}
+		attempt >>= 1;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                extend_sects
+ *****************************************************************************/
+/**
+ * Allocate the free sectors right from `sect' on, at most `nr' of them.
+ * Used to grow a run in place.
+ *
+ * @param dev   In which device the sector-map is located.
+ * @param sect  The 1st sector wanted.
+ * @param nr    How many sectors are wanted.
+ *
+ * @return  How many sectors have been allocated (may be 0).
+ *****************************************************************************/
+PUBLIC int extend_sects(int dev, int sect, int nr)
+{
+	assert(dev == map_dev);
+
+	int bit = sect - first_sect;
+	int n = 0;
+	while (n < nr && bit + n < nr_data_bits) {
+		int b = bit + n;
+		u32 x = smap[b / 32] >> (b % 32);
+		if (x == 0) {
+			/* the rest of this word is free */
+			n += 32 - b % 32;
+			continue;
+		}
+		int z = bsf(x);
+		n += z;
+		break;
+	}
+	n = min(n, nr);
+	n = min(n, nr_data_bits - bit);
+
+	if (n > 0)
+		set_smap_bits(dev, bit, n);
+	return n;
+}
+
+/*****************************************************************************
+ *                                free_sects
+ *****************************************************************************/
+/**
+ * Free data sectors.
+ *
+ * @param dev   In which device the sector-map is located.
+ * @param sect  The 1st sector.
+ * @param nr    How many sectors.
+ *****************************************************************************/
+PUBLIC void free_sects(int dev, int sect, int nr)
+{
+	if (sect < first_sect || nr <= 0)
+		panic("invalid smap release request\n");
+	free_smap_bits(dev, sect - first_sect, nr);
+}
+
+/*****************************************************************************
+ *                                set_smap_bits
+ *****************************************************************************/
+/**
+ * Mark `n' bits in sector-map as used, starting from bit `bit'. Bits that
+ * are already set are left alone.
+ *
+ * @param dev  In which device the sector-map is located.
+ * @param bit  The 1st bit.
+ * @param n    How many bits.
+ *****************************************************************************/
+PUBLIC void set_smap_bits(int dev, int bit, int n)
+{
+	assert(dev == map_dev);
+	change_smap_bits(bit, n, 1);
+}
+
+/*****************************************************************************
+ *                                free_smap_bits
+ *****************************************************************************/
+/**
+ * Clear `n' bits in sector-map, starting from bit `bit'.
+ *
+ * @param dev  In which device the sector-map is located.
+ * @param bit  The 1st bit.
+ * @param n    How many bits.
+ *****************************************************************************/
+PUBLIC void free_smap_bits(int dev, int bit, int n)
+{
+	assert(dev == map_dev);
+	change_smap_bits(bit, n, 0);
+}
+
+/*****************************************************************************
+ *                                change_smap_bits
+ *****************************************************************************/
+/**
+ * Set or clear a range of sector-map, a word at a time where possible, and
+ * keep smap_free[] and smap_dirty[] up to date.
+ *
+ *****************************************************************************/
+PRIVATE void change_smap_bits(int bit, int n, int set)
+{
+	if (bit < 0 || n <= 0 || bit + n > nr_smap_sects * BITS_PER_SECT)
+		panic("invalid smap range: %d, %d\n", bit, n);
+
+	while (n > 0) {
+		int k = bit % 32;
+		int cnt = min(n, 32 - k);
+		u32 mask = (cnt == 32) ? 0xFFFFFFFF : (((1u << cnt) - 1) << k);
+		u32 * w = &smap[bit / 32];
+		int sect = bit / BITS_PER_SECT;
+
+		int before = count_zero_bits(*w);
+		if (set)
+			*w |= mask;
+		else
+			*w &= ~mask;
+		smap_free[sect] += count_zero_bits(*w) - before;
+		smap_dirty[sect] = 1;
+
+		bit += cnt;
+		n -= cnt;
+	}
+}
+
+/*****************************************************************************
+ *                                bsf
+ *****************************************************************************/
+/**
+ * Index of the lowest set bit. `x' must not be zero.
+ *
+ *****************************************************************************/
+PRIVATE int bsf(u32 x)
+{
+	int r;
+	__asm__ ("bsfl %1, %0" : "=r"(r) : "rm"(x));
+	return r;
+}
+
+/*****************************************************************************
+ *                                count_zero_bits
+ *****************************************************************************/
+PRIVATE int count_zero_bits(u32 x)
+{
+	int n = 0;
+	x = ~x;
+	while (x) {
+		x &= x - 1;
+		n++;
+	}
+	return n;
+}
@@ -0,0 +1,415 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   cache.c
+ * @brief  Buffer cache.
+ *
+ * Every sector FS reads or writes through RD_SECT()/WR_SECT() goes through
+ * buf_table[]. Buffers are hashed by (dev, sector nr) and kept on an LRU
+ * list. WR_SECT() only dirties the buffer; dirty buffers reach the disk when
+ * they are evicted or when sync_blocks() is called.
+ *
+ * Buffers holding metadata (everything written by WR_SECT(), plus the
+ * directory and extent sectors marked by mark_meta_dirty()) are not written
+ * back that way: they go through journal_commit() so that they reach the
+ * disk together. They are not evicted while dirty unless nothing else can
+ * be.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+#define	BUF_HASH(dev,nr)	(((u32)(dev) * 31 + (u32)(nr)) % NR_BUF_HASH)
+
+PRIVATE struct buf	buf_table[NR_BUF];
+PRIVATE struct buf *	buf_hash[NR_BUF_HASH];
+PRIVATE struct buf	lru;		/**< lru.b_next is the least recently
+					 *   used one, lru.b_prev the most */
+
+PRIVATE int		bc_hits;
+PRIVATE int		bc_misses;
+PRIVATE int		bc_writes;	/**< sectors written back */
+
+PRIVATE struct buf *	find_buf(int dev, int nr);
+PRIVATE void		unhash_buf(struct buf * bp);
+PRIVATE void		lru_unlink(struct buf * bp);
+PRIVATE void		lru_append(struct buf * bp);
+
+/*****************************************************************************
+ *                                init_bcache
+ *****************************************************************************/
+/**
+ * <Ring 1> Hand out bcachebuf among the buffers and put all of them on the
+ * LRU list. Must be called before the first RD_SECT().
+ *
+ *****************************************************************************/
+PUBLIC void init_bcache()
+{
+	int i;
+
+	lru.b_next = lru.b_prev = &lru;
+	for (i = 0; i < NR_BUF_HASH; i++)
+		buf_hash[i] = 0;
+
+	for (i = 0; i < NR_BUF; i++) {
+		struct buf * bp = &buf_table[i];
+		bp->b_dev   = NO_DEV;
+		bp->b_nr    = 0;
+		bp->b_dirty = 0;
+		bp->b_meta  = 0;
+		bp->b_data  = bcachebuf + i * SECTOR_SIZE;
+		bp->b_hnext = 0;
+		lru_append(bp);
+	}
+
+	bc_hits = bc_misses = bc_writes = 0;
+}
+
+/*****************************************************************************
+ *                                bread
+ *****************************************************************************/
+/**
+ * <Ring 1> Copy a sector into fsbuf, from the cache if it is there.
+ *
+ * @param dev  Device nr.
+ * @param nr   Sector nr.
+ *****************************************************************************/
+PUBLIC void bread(int dev, int nr)
+{
+	struct buf * bp = get_buf(dev, nr, 1);
+	memcpy(fsbuf, bp->b_data, SECTOR_SIZE);
+}
+
+/*****************************************************************************
+ *                                bwrite
+ *****************************************************************************/
+/**
+ * <Ring 1> Copy the first sector of fsbuf into the cache and mark it dirty
+ * metadata. The disk is not touched until the journal is committed.
+ *
+ * @param dev  Device nr.
+ * @param nr   Sector nr.
+ *****************************************************************************/
+PUBLIC void bwrite(int dev, int nr)
+{
+	struct buf * bp = get_buf(dev, nr, 0);
+	memcpy(bp->b_data, fsbuf, SECTOR_SIZE);
+	mark_meta_dirty(bp);
+}
+
+/*****************************************************************************
+ *                                mark_meta_dirty
+ *****************************************************************************/
+/**
+ * <Ring 1> Mark a buffer which has been changed in place as dirty metadata.
+ *
+ * @param bp  The buffer.
+ *****************************************************************************/
+PUBLIC void mark_meta_dirty(struct buf * bp)
+{
+	bp->b_dirty = 1;
+	bp->b_meta = 1;
+}
+
+/*****************************************************************************
+ *                                peek_buf
+ *****************************************************************************/
+/**
+ * <Ring 1> Get the buffer of a sector only if it is cached. The disk is not
+ * touched.
+ *
+ * @param dev  Device nr.
+ * @param nr   Sector nr.
+ *
+ * @return  The buffer, or 0 if the sector is not cached.
+ *****************************************************************************/
+PUBLIC struct buf * peek_buf(int dev, int nr)
+{
+	struct buf * bp = find_buf(dev, nr);
+	if (!bp)
+		return 0;
+
+	bc_hits++;
+	lru_unlink(bp);
+	lru_append(bp);
+	return bp;
+}
+
+/*****************************************************************************
+ *                                fill_blocks
+ *****************************************************************************/
+/**
+ * <Ring 1> Put sectors which have just been read from the disk into the
+ * cache, e.g. the ones read ahead. Sectors already cached are left alone
+ * since they may be newer.
+ *
+ * @param dev   Device nr.
+ * @param nr    The first sector.
+ * @param cnt   How many sectors.
+ * @param data  The sectors.
+ *****************************************************************************/
+PUBLIC void fill_blocks(int dev, int nr, int cnt, u8 * data)
+{
+	int i;
+	for (i = 0; i < cnt; i++) {
+		if (find_buf(dev, nr + i))
+			continue;
+		struct buf * bp = get_buf(dev, nr + i, 0);
+		bc_misses--;	/* not a lookup */
+		memcpy(bp->b_data, data + i * SECTOR_SIZE, SECTOR_SIZE);
+	}
+}
+
+/*****************************************************************************
+ *                                sync_blocks
+ *****************************************************************************/
+/**
+ * <Ring 1> Write back dirty data buffers in [nr, nr + cnt) of the device.
+ * They stay in the cache. Metadata is left to journal_commit().
+ *
+ * @param dev  Device nr, or NO_DEV for all devices.
+ * @param nr   The first sector.
+ * @param cnt  How many sectors, or 0 for all of them.
+ *
+ * @return  How many sectors were written.
+ *****************************************************************************/
+PUBLIC int sync_blocks(int dev, int nr, int cnt)
+{
+	int n = 0;
+	struct buf * bp;
+	for (bp = &buf_table[0]; bp < &buf_table[NR_BUF]; bp++) {
+		if (!bp->b_dirty || bp->b_meta)
+			continue;
+		if (dev != NO_DEV && bp->b_dev != dev)
+			continue;
+		if (cnt && (bp->b_nr < nr || bp->b_nr >= nr + cnt))
+			continue;
+		write_buf(bp);
+		n++;
+	}
+	return n;
+}
+
+/*****************************************************************************
+ *                                dirty_meta_bufs
+ *****************************************************************************/
+/**
+ * <Ring 1> Collect dirty metadata buffers, for journal_commit().
+ *
+ * @param list  Where to put them.
+ * @param max   How many `list' can hold.
+ *
+ * @return  How many were put into `list'.
+ *****************************************************************************/
+PUBLIC int dirty_meta_bufs(struct buf ** list, int max)
+{
+	int n = 0;
+	struct buf * bp;
+	for (bp = &buf_table[0]; bp < &buf_table[NR_BUF] && n < max; bp++)
+		if (bp->b_dirty && bp->b_meta)
+			list[n++] = bp;
+	return n;
+}
+
+/*****************************************************************************
+ *                                inval_blocks
+ *****************************************************************************/
+/**
+ * <Ring 1> Drop the cached copies of [nr, nr + cnt), dirty or not. Used
+ * after the sectors have been written to the disk behind the cache's back.
+ *
+ * @param dev  Device nr.
+ * @param nr   The first sector.
+ * @param cnt  How many sectors.
+ *****************************************************************************/
+PUBLIC void inval_blocks(int dev, int nr, int cnt)
+{
+	struct buf * bp;
+	for (bp = &buf_table[0]; bp < &buf_table[NR_BUF]; bp++) {
+		if (bp->b_dev != dev || bp->b_nr < nr || bp->b_nr >= nr + cnt)
+			continue;
+		unhash_buf(bp);
+		bp->b_dev = NO_DEV;
+		bp->b_dirty = 0;
+		bp->b_meta = 0;
+		/* reuse it first */
+		lru_unlink(bp);
+		bp->b_next = lru.b_next;
+		bp->b_prev = &lru;
+		lru.b_next->b_prev = bp;
+		lru.b_next = bp;
+	}
+}
+
+/*****************************************************************************
+ *                                bcache_stat
+ *****************************************************************************/
+/**
+ * <Ring 1> Report the counters of the cache.
+ *
+ * @param hits    Lookups satisfied from memory.
+ * @param misses  Lookups that went to the disk.
+ * @param writes  Sectors written back.
+ *****************************************************************************/
+PUBLIC void bcache_stat(int * hits, int * misses, int * writes)
+{
+	*hits = bc_hits;
+	*misses = bc_misses;
+	*writes = bc_writes;
+}
+
+/*****************************************************************************
+ *                                find_buf
+ *****************************************************************************/
+/**
+ * Look the sector up in the hash table.
+ *
+ * @return  The buffer, or 0 if the sector is not cached.
+ *****************************************************************************/
+PRIVATE struct buf * find_buf(int dev, int nr)
+{
+	struct buf * bp = buf_hash[BUF_HASH(dev, nr)];
+	for (; bp; bp = bp->b_hnext)
+		if (bp->b_dev == dev && bp->b_nr == nr)
+			return bp;
+	return 0;
+}
+
+/*****************************************************************************
+ *                                get_buf
+ *****************************************************************************/
+/**
+ * <Ring 1> Get the buffer of a sector and make it the most recently used
+ * one. On a miss the least recently used buffer which isn't dirty metadata
+ * is written back (if dirty) and reused. If all of them are, the journal is
+ * committed first.
+ *
+ * The caller may work on b_data directly (setting b_dirty if it changes
+ * it), but only until the next call into the cache, which may reuse the
+ * buffer.
+ *
+ * @param dev   Device nr.
+ * @param nr    Sector nr.
+ * @param read  Whether to fill the buffer from the disk on a miss. WR_SECT()
+ *              overwrites the whole sector so it doesn't need to.
+ *
+ * @return  The buffer.
+ *****************************************************************************/
+PUBLIC struct buf * get_buf(int dev, int nr, int read)
+{
+	struct buf * bp = find_buf(dev, nr);
+
+	if (bp) {
+		bc_hits++;
+	}
+	else {
+		bc_misses++;
+
+		bp = lru.b_next;
+		while (bp != &lru && bp->b_dirty && bp->b_meta)
+			bp = bp->b_next;
+		if (bp == &lru) {
+			journal_commit();
+			bp = lru.b_next;
+		}
+		assert(bp != &lru);
+		if (bp->b_dirty)
+			write_buf(bp);
+		unhash_buf(bp);
+
+		bp->b_dev = dev;
+		bp->b_nr  = nr;
+		bp->b_meta = 0;
+		int h = BUF_HASH(dev, nr);
+		bp->b_hnext = buf_hash[h];
+		buf_hash[h] = bp;
+
+		if (read)
+			rw_sector(DEV_READ, dev, (u64)nr * SECTOR_SIZE,
+				  SECTOR_SIZE, TASK_FS, bp->b_data);
+	}
+
+	lru_unlink(bp);
+	lru_append(bp);
+	return bp;
+}
+
+/*****************************************************************************
+ *                                write_buf
+ *****************************************************************************/
+/**
+ * <Ring 1> Write a dirty buffer to its home sector.
+ *
+ * @param bp  The buffer.
+ *****************************************************************************/
+PUBLIC void write_buf(struct buf * bp)
+{
+	assert(bp->b_dirty && bp->b_dev != NO_DEV);
+	rw_sector(DEV_WRITE, bp->b_dev, (u64)bp->b_nr * SECTOR_SIZE,
+		  SECTOR_SIZE, TASK_FS, bp->b_data);
+	bp->b_dirty = 0;
+	bp->b_meta = 0;
+	bc_writes++;
+}
+
+/*****************************************************************************
+ *                                unhash_buf
+ *****************************************************************************/
+/**
+ * Take a buffer off its hash chain.
+ *
+ *****************************************************************************/
+PRIVATE void unhash_buf(struct buf * bp)
+{
+	if (bp->b_dev == NO_DEV)
+		return;
+
+	int h = BUF_HASH(bp->b_dev, bp->b_nr);
+	if (buf_hash[h] == bp) {
+		buf_hash[h] = bp->b_hnext;
+	}
+	else {
+		struct buf * p = buf_hash[h];
+		for (; p; p = p->b_hnext) {
+			if (p->b_hnext == bp) {
+				p->b_hnext = bp->b_hnext;
+				break;
+			}
+		}
+	}
+	bp->b_hnext = 0;
+}
+
+/*****************************************************************************
+ *                                lru_unlink
+ *****************************************************************************/
+PRIVATE void lru_unlink(struct buf * bp)
+{
+	bp->b_prev->b_next = bp->b_next;
+	bp->b_next->b_prev = bp->b_prev;
+}
+
+/*****************************************************************************
+ *                                lru_append
+ *****************************************************************************/
+/**
+ * Put a buffer at the most recently used end of the LRU list.
+ *
+ *****************************************************************************/
+PRIVATE void lru_append(struct buf * bp)
+{
+	bp->b_next = &lru;
+	bp->b_prev = lru.b_prev;
+	lru.b_prev->b_next = bp;
+	lru.b_prev = bp;
+}
@@ -0,0 +1,207 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   dcache.c
+ * @brief  Directory entry cache.
+ *
+ * dir_lookup() remembers what it found -- and what it didn't -- in
+ * dentry_table[], so that a name is looked up in the directory sectors only
+ * once. dir_add() and dir_remove() keep the cache up to date.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+PRIVATE struct dentry	dentry_table[NR_DENTRY];
+PRIVATE struct dentry *	dentry_hash[NR_DENTRY_HASH];
+PRIVATE int		next_victim;	/**< slots are reused round-robin */
+
+PRIVATE int		dentry_hash_of(int dev, int dir, const char * name);
+PRIVATE struct dentry *	find_dentry(int dev, int dir, const char * name);
+PRIVATE void		dentry_unhash(struct dentry * d);
+PRIVATE void		pad_name(char * dst, const char * name);
+
+/*****************************************************************************
+ *                                init_dcache
+ *****************************************************************************/
+/**
+ * <Ring 1> Empty the cache.
+ *
+ *****************************************************************************/
+PUBLIC void init_dcache()
+{
+	int i;
+	for (i = 0; i < NR_DENTRY_HASH; i++)
+		dentry_hash[i] = 0;
+	for (i = 0; i < NR_DENTRY; i++) {
+		dentry_table[i].d_dev = NO_DEV;
+		dentry_table[i].d_hnext = 0;
+	}
+	next_victim = 0;
+}
+
+/*****************************************************************************
+ *                                dcache_lookup
+ *****************************************************************************/
+/**
+ * <Ring 1> Look a name up in the cache.
+ *
+ * @param dev   Device nr.
+ * @param dir   I-node nr of the directory.
+ * @param name  Filename.
+ *
+ * @return  The i-node nr, INVALID_INODE if the name is known not to exist,
+ *          or -1 if the cache knows nothing about it.
+ *****************************************************************************/
+PUBLIC int dcache_lookup(int dev, int dir, const char * name)
+{
+	struct dentry * d = find_dentry(dev, dir, name);
+	return d ? d->d_inode_nr : -1;
+}
+
+/*****************************************************************************
+ *                                dcache_enter
+ *****************************************************************************/
+/**
+ * <Ring 1> Record that `name' in the directory is `inode_nr'. A negative
+ * entry is recorded with inode_nr == INVALID_INODE.
+ *
+ * @param dev       Device nr.
+ * @param dir       I-node nr of the directory.
+ * @param name      Filename.
+ * @param inode_nr  I-node nr of the file.
+ *****************************************************************************/
+PUBLIC void dcache_enter(int dev, int dir, const char * name, int inode_nr)
+{
+	struct dentry * d = find_dentry(dev, dir, name);
+	if (d) {
+		d->d_inode_nr = inode_nr;
+		return;
+	}
+
+	d = &dentry_table[next_victim];
+	next_victim = (next_victim + 1) % NR_DENTRY;
+	dentry_unhash(d);
+
+	d->d_dev = dev;
+	d->d_dir = dir;
+	d->d_inode_nr = inode_nr;
+	pad_name(d->d_name, name);
+
+	int h = dentry_hash_of(dev, dir, d->d_name);
+	d->d_hnext = dentry_hash[h];
+	dentry_hash[h] = d;
+}
+
+/*****************************************************************************
+ *                                dcache_purge
+ *****************************************************************************/
+/**
+ * <Ring 1> Forget every entry of a directory, e.g. when the directory is
+ * removed.
+ *
+ * @param dev  Device nr.
+ * @param dir  I-node nr of the directory.
+ *****************************************************************************/
+PUBLIC void dcache_purge(int dev, int dir)
+{
+	struct dentry * d;
+	for (d = &dentry_table[0]; d < &dentry_table[NR_DENTRY]; d++) {
+		if (d->d_dev == dev && d->d_dir == dir) {
+			dentry_unhash(d);
+			d->d_dev = NO_DEV;
+		}
+	}
+}
+
+/*****************************************************************************
+ *                                dentry_hash_of
+ *****************************************************************************/
+/**
+ * Hash of a (dev, dir, name) key. `name' must be padded by pad_name().
+ *
+ *****************************************************************************/
+PRIVATE int dentry_hash_of(int dev, int dir, const char * name)
+{
+	u32 h = (u32)dev * 31 + (u32)dir;
+	int i;
+	for (i = 0; i < MAX_FILENAME_LEN; i++)
+		h = h * 31 + (u8)name[i];
+	return h % NR_DENTRY_HASH;
+}
+
+/*****************************************************************************
+ *                                find_dentry
+ *****************************************************************************/
+/**
+ * Find the cache entry of a name.
+ *
+ * @return  The entry, or 0 if not cached.
+ *****************************************************************************/
+PRIVATE struct dentry * find_dentry(int dev, int dir, const char * name)
+{
+	char key[MAX_FILENAME_LEN];
+	pad_name(key, name);
+
+	struct dentry * d = dentry_hash[dentry_hash_of(dev, dir, key)];
+	for (; d; d = d->d_hnext)
+		if (d->d_dev == dev && d->d_dir == dir &&
+		    memcmp(d->d_name, key, MAX_FILENAME_LEN) == 0)
+			return d;
+	return 0;
+}
+
+/*****************************************************************************
+ *                                dentry_unhash
+ *****************************************************************************/
+/**
+ * Take an entry off its hash chain.
+ *
+ *****************************************************************************/
+PRIVATE void dentry_unhash(struct dentry * d)
+{
+	if (d->d_dev == NO_DEV)
+		return;
+
+	int h = dentry_hash_of(d->d_dev, d->d_dir, d->d_name);
+	if (dentry_hash[h] == d) {
+		dentry_hash[h] = d->d_hnext;
+	}
+	else {
+		struct dentry * p = dentry_hash[h];
+		for (; p; p = p->d_hnext) {
+			if (p->d_hnext == d) {
+				p->d_hnext = d->d_hnext;
+				break;
+			}
+		}
+	}
+	d->d_hnext = 0;
+}
+
+/*****************************************************************************
+ *                                pad_name
+ *****************************************************************************/
+/**
+ * Copy a filename into a MAX_FILENAME_LEN buffer and pad it with zeros,
+ * the way names are compared in the directory.
+ *
+ *****************************************************************************/
+PRIVATE void pad_name(char * dst, const char * name)
+{
+	int i;
+	for (i = 0; i < MAX_FILENAME_LEN && name[i]; i++)
+		dst[i] = name[i];
+	for (; i < MAX_FILENAME_LEN; i++)
+		dst[i] = 0;
+}
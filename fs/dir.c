@@ -0,0 +1,522 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   dir.c
+ * @brief  Directories.
+ *
+ * A directory is still an array of dir_entry, but each one also has a name
+ * index (see struct dir_index) so that a name is found by hashing it rather
+ * than by reading every entry. The index is built the first time it is
+ * needed, so directories made before it existed get one too, and it is
+ * rebuilt twice as large when it fills up. If there is no room on the disk
+ * for an index the directory is simply searched the old way.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+PRIVATE struct dir_entry *	dir_slot(struct inode * dir, int slot, int dirty);
+PRIVATE int			scan_slots(struct inode * dir, const char * name);
+PRIVATE int			name_eq(const char * de_name, const char * name);
+PRIVATE u32			name_hash(const char * name);
+PRIVATE struct dir_index *	idx_hdr(int dev, int idx, int dirty);
+PRIVATE u32 *			idx_bucket(int dev, int idx, int b, int dirty);
+PRIVATE int			idx_ensure(struct inode * dir);
+PRIVATE int			idx_build(struct inode * dir, int nr_sects);
+PRIVATE int			idx_find(struct inode * dir, const char * name,
+					 int * slot);
+PRIVATE void			idx_put(struct inode * dir, const char * name,
+					int slot);
+
+/*****************************************************************************
+ *                                dir_lookup
+ *****************************************************************************/
+/**
+ * <Ring 1> Look a name up in a directory.
+ *
+ * @param dir   I-node of the directory.
+ * @param name  Filename.
+ *
+ * @return  The i-node nr, or INVALID_INODE if there is no such name.
+ *****************************************************************************/
+PUBLIC int dir_lookup(struct inode * dir, const char * name)
+{
+	/* the root has no ".." entry: it is its own parent */
+	if (dir->i_num == ROOT_INODE && strcmp(name, "..") == 0)
+		return ROOT_INODE;
+
+	int inode_nr = dcache_lookup(dir->i_dev, dir->i_num, name);
+	if (inode_nr != -1)
+		return inode_nr;
+
+	int slot = -1;
+	if (idx_ensure(dir))
+		idx_find(dir, name, &slot);
+	else
+		slot = scan_slots(dir, name);
+
+	inode_nr = slot < 0 ? INVALID_INODE : dir_slot(dir, slot, 0)->inode_nr;
+
+	/* remember it, whether it is there or not */
+	dcache_enter(dir->i_dev, dir->i_num, name, inode_nr);
+	return inode_nr;
+}
+
+/*****************************************************************************
+ *                                dir_add
+ *****************************************************************************/
+/**
+ * <Ring 1> Add a name to a directory. The caller makes sure the name is not
+ * there yet.
+ *
+ * @param dir       I-node of the directory.
+ * @param name      Filename.
+ * @param inode_nr  I-node nr of the file.
+ *
+ * @return  Zero if successful, -1 if the directory cannot grow.
+ *****************************************************************************/
+PUBLIC int dir_add(struct inode * dir, const char * name, int inode_nr)
+{
+	int dev = dir->i_dev;
+	int nr_slots = dir->i_size / DIR_ENTRY_SIZE;
+	int idx = idx_ensure(dir);
+	int slot = 0;
+
+	if (idx) {
+		struct dir_index * hdr = idx_hdr(dev, idx, 0);
+		int nr_buckets = (hdr->di_nr_sects - 1) * BUCKETS_PER_SECT;
+
+		/* keep the load below 3/4, counting tombstones */
+		if ((hdr->di_used + hdr->di_tomb + 1) * 4 > nr_buckets * 3) {
+			int want = (hdr->di_used + 1) * 2;
+			int nr_sects = 1 + (want + BUCKETS_PER_SECT - 1) /
+				BUCKETS_PER_SECT;
+			if (nr_sects < DIR_IDX_MIN_SECTS)
+				nr_sects = DIR_IDX_MIN_SECTS;
+			if (!idx_build(dir, nr_sects))
+				dir_free_index(dir); /* carry on without one */
+			idx = dir->i_dir_idx;
+		}
+		if (idx)
+			slot = idx_hdr(dev, idx, 0)->di_free;
+	}
+
+	/* find a free slot, or append one */
+	for (; slot < nr_slots; slot++)
+		if (dir_slot(dir, slot, 0)->inode_nr == INVALID_INODE)
+			break;
+	if (slot == nr_slots) {
+		int lsect = slot / ENTRIES_PER_SECT;
+		if (grow_file(dir, lsect + 1) < lsect + 1)
+			return -1;
+		if (slot % ENTRIES_PER_SECT == 0) {
+			/* a new sector, don't trust what's on the disk */
+			struct buf * bp = get_buf(dev, bmap(dir, lsect, 0), 0);
+			memset(bp->b_data, 0, SECTOR_SIZE);
+			mark_meta_dirty(bp);
+		}
+		dir->i_size += DIR_ENTRY_SIZE;
+	}
+
+	struct dir_entry * de = dir_slot(dir, slot, 1);
+	de->inode_nr = inode_nr;
+	memset(de->name, 0, MAX_FILENAME_LEN);
+	memcpy(de->name, (void *)name, min(strlen(name), MAX_FILENAME_LEN));
+
+	if (idx) {
+		idx_put(dir, name, slot);
+		idx_hdr(dev, idx, 1)->di_free = slot + 1;
+	}
+
+	sync_inode(dir);
+	dcache_enter(dev, dir->i_num, name, inode_nr);
+	return 0;
+}
+
+/*****************************************************************************
+ *                                dir_remove
+ *****************************************************************************/
+/**
+ * <Ring 1> Remove a name from a directory. Free slots at the end of the
+ * directory are cut off.
+ *
+ * @param dir   I-node of the directory.
+ * @param name  Filename.
+ *
+ * @return  Zero if successful, -1 if there is no such name.
+ *****************************************************************************/
+PUBLIC int dir_remove(struct inode * dir, const char * name)
+{
+	int dev = dir->i_dev;
+	int idx = idx_ensure(dir);
+	int slot = -1;
+
+	if (idx) {
+		int b = idx_find(dir, name, &slot);
+		if (b >= 0) {
+			*idx_bucket(dev, idx, b, 1) = DIR_IDX_TOMB;
+			struct dir_index * hdr = idx_hdr(dev, idx, 1);
+			hdr->di_used--;
+			hdr->di_tomb++;
+			if (slot < hdr->di_free)
+				hdr->di_free = slot;
+		}
+	}
+	else {
+		slot = scan_slots(dir, name);
+	}
+	if (slot < 0)
+		return -1;
+
+	memset(dir_slot(dir, slot, 1), 0, DIR_ENTRY_SIZE);
+
+	int nr_slots = dir->i_size / DIR_ENTRY_SIZE;
+	while (nr_slots > 0 &&
+	       dir_slot(dir, nr_slots - 1, 0)->inode_nr == INVALID_INODE)
+		nr_slots--;
+	dir->i_size = nr_slots * DIR_ENTRY_SIZE;
+	sync_inode(dir);
+
+	dcache_enter(dev, dir->i_num, name, INVALID_INODE);
+	return 0;
+}
+
+/*****************************************************************************
+ *                                dir_is_empty
+ *****************************************************************************/
+/**
+ * <Ring 1> Whether a directory has nothing but "." and "..".
+ *
+ * @param dir  I-node of the directory.
+ *
+ * @return  1 if it is empty, otherwise 0.
+ *****************************************************************************/
+PUBLIC int dir_is_empty(struct inode * dir)
+{
+	int nr_slots = dir->i_size / DIR_ENTRY_SIZE;
+	int slot;
+
+	for (slot = 0; slot < nr_slots; slot++) {
+		struct dir_entry * de = dir_slot(dir, slot, 0);
+		if (de->inode_nr == INVALID_INODE)
+			continue;
+		if (!name_eq(de->name, ".") && !name_eq(de->name, ".."))
+			return 0;
+	}
+	return 1;
+}
+
+/*****************************************************************************
+ *                                dir_free_index
+ *****************************************************************************/
+/**
+ * <Ring 1> Free the name index of a directory, if it has one.
+ *
+ * @param dir  I-node of the directory.
+ *****************************************************************************/
+PUBLIC void dir_free_index(struct inode * dir)
+{
+	int idx = dir->i_dir_idx;
+	if (!idx)
+		return;
+
+	int nr_sects = idx_hdr(dir->i_dev, idx, 0)->di_nr_sects;
+	free_sects(dir->i_dev, idx, nr_sects);
+	inval_blocks(dir->i_dev, idx, nr_sects);
+	dir->i_dir_idx = 0;
+	sync_inode(dir);
+}
+
+/*****************************************************************************
+ *                                dir_next
+ *****************************************************************************/
+/**
+ * <Ring 1> Find the first entry in use at or after a slot, for walking
+ * through a directory.
+ *
+ * @param dir   I-node of the directory.
+ * @param slot  Slot nr to start from, set to the slot of the entry found.
+ * @param name  Gets the name, MAX_FILENAME_LEN bytes, not always 0-ended.
+ *
+ * @return  I-node nr of the entry, or INVALID_INODE if there's no more.
+ *****************************************************************************/
+PUBLIC int dir_next(struct inode * dir, int * slot, char * name)
+{
+	int nr_slots = dir->i_size / DIR_ENTRY_SIZE;
+
+	for (; *slot < nr_slots; (*slot)++) {
+		struct dir_entry * de = dir_slot(dir, *slot, 0);
+		if (de->inode_nr != INVALID_INODE) {
+			memcpy(name, de->name, MAX_FILENAME_LEN);
+			return de->inode_nr;
+		}
+	}
+	return INVALID_INODE;
+}
+
+/*****************************************************************************
+ *                                dir_slot
+ *****************************************************************************/
+/**
+ * Get a directory entry by its slot nr. The pointer is into the buffer
+ * cache, so it is only good until the next call into the cache.
+ *
+ * @param dir    I-node of the directory.
+ * @param slot   Slot nr.
+ * @param dirty  Whether the caller is going to change the entry.
+ *
+ * @return  The entry.
+ *****************************************************************************/
+PRIVATE struct dir_entry * dir_slot(struct inode * dir, int slot, int dirty)
+{
+	int sect = bmap(dir, slot / ENTRIES_PER_SECT, 0);
+	assert(sect);
+
+	struct buf * bp = get_buf(dir->i_dev, sect, 1);
+	if (dirty)
+		mark_meta_dirty(bp);
+	return (struct dir_entry *)bp->b_data + slot % ENTRIES_PER_SECT;
+}
+
+/*****************************************************************************
+ *                                scan_slots
+ *****************************************************************************/
+/**
+ * Look a name up by reading every entry, for directories without an index.
+ *
+ * @return  The slot nr, or -1 if there is no such name.
+ *****************************************************************************/
+PRIVATE int scan_slots(struct inode * dir, const char * name)
+{
+	int nr_slots = dir->i_size / DIR_ENTRY_SIZE;
+	int slot;
+
+	for (slot = 0; slot < nr_slots; slot++) {
+		struct dir_entry * de = dir_slot(dir, slot, 0);
+		if (de->inode_nr != INVALID_INODE && name_eq(de->name, name))
+			return slot;
+	}
+	return -1;
+}
+
+/*****************************************************************************
+ *                                name_eq
+ *****************************************************************************/
+/**
+ * Compare the name of a dir_entry, which is not always 0-terminated, with a
+ * filename.
+ *
+ *****************************************************************************/
+PRIVATE int name_eq(const char * de_name, const char * name)
+{
+	int i;
+	for (i = 0; i < MAX_FILENAME_LEN; i++) {
+		if (de_name[i] != name[i])
+			return 0;
+		if (name[i] == 0)
+			break;
+	}
+	return 1;
+}
+
+/*****************************************************************************
+ *                                name_hash
+ *****************************************************************************/
+/**
+ * FNV-1a of a filename.
+ *
+ *****************************************************************************/
+PRIVATE u32 name_hash(const char * name)
+{
+	u32 h = 2166136261u;
+	int i;
+	for (i = 0; i < MAX_FILENAME_LEN && name[i]; i++) {
+		h ^= (u8)name[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/*****************************************************************************
+ *                                idx_hdr
+ *****************************************************************************/
+/**
+ * Get the header of an index. Like dir_slot(), the pointer is into the
+ * buffer cache.
+ *
+ *****************************************************************************/
+PRIVATE struct dir_index * idx_hdr(int dev, int idx, int dirty)
+{
+	struct buf * bp = get_buf(dev, idx, 1);
+	if (dirty)
+		mark_meta_dirty(bp);
+	return (struct dir_index *)bp->b_data;
+}
+
+/*****************************************************************************
+ *                                idx_bucket
+ *****************************************************************************/
+/**
+ * Get the b-th bucket of an index. Like dir_slot(), the pointer is into the
+ * buffer cache.
+ *
+ *****************************************************************************/
+PRIVATE u32 * idx_bucket(int dev, int idx, int b, int dirty)
+{
+	struct buf * bp = get_buf(dev, idx + 1 + b / BUCKETS_PER_SECT, 1);
+	if (dirty)
+		mark_meta_dirty(bp);
+	return (u32 *)bp->b_data + b % BUCKETS_PER_SECT;
+}
+
+/*****************************************************************************
+ *                                idx_ensure
+ *****************************************************************************/
+/**
+ * Make sure a directory has an index.
+ *
+ * @return  The first sector of the index, or 0 if it has none.
+ *****************************************************************************/
+PRIVATE int idx_ensure(struct inode * dir)
+{
+	if (dir->i_dir_idx) {
+		assert(idx_hdr(dir->i_dev, dir->i_dir_idx, 0)->di_magic ==
+		       DIR_IDX_MAGIC);
+		return dir->i_dir_idx;
+	}
+
+	int nr_sects = DIR_IDX_MIN_SECTS;
+	int want = dir->i_size / DIR_ENTRY_SIZE * 2;
+	while ((nr_sects - 1) * BUCKETS_PER_SECT < want)
+		nr_sects *= 2;
+	return idx_build(dir, nr_sects);
+}
+
+/*****************************************************************************
+ *                                idx_build
+ *****************************************************************************/
+/**
+ * Build a new index of `nr_sects' sectors from the entries of a directory,
+ * replacing the old one (if any).
+ *
+ * @return  The first sector of the index, or 0 if there is no room for it.
+ *****************************************************************************/
+PRIVATE int idx_build(struct inode * dir, int nr_sects)
+{
+	int dev = dir->i_dev;
+	int got = nr_sects;
+	int idx = alloc_sects(dev, &got);
+	if (!idx)
+		return 0;
+	if (got < nr_sects) {
+		free_sects(dev, idx, got);
+		return 0;
+	}
+
+	int i;
+	for (i = 0; i < nr_sects; i++) {
+		struct buf * bp = get_buf(dev, idx + i, 0);
+		memset(bp->b_data, 0, SECTOR_SIZE);
+		mark_meta_dirty(bp);
+	}
+
+	int free_hint = 0;
+	if (dir->i_dir_idx) {
+		free_hint = idx_hdr(dev, dir->i_dir_idx, 0)->di_free;
+		dir_free_index(dir);
+	}
+
+	struct dir_index * hdr = idx_hdr(dev, idx, 1);
+	hdr->di_magic = DIR_IDX_MAGIC;
+	hdr->di_nr_sects = nr_sects;
+	hdr->di_free = free_hint;
+	dir->i_dir_idx = idx;
+
+	int nr_slots = dir->i_size / DIR_ENTRY_SIZE;
+	int slot;
+	for (slot = 0; slot < nr_slots; slot++) {
+		char name[MAX_FILENAME_LEN + 1];
+		struct dir_entry * de = dir_slot(dir, slot, 0);
+		if (de->inode_nr == INVALID_INODE)
+			continue;
+		memcpy(name, de->name, MAX_FILENAME_LEN);
+		name[MAX_FILENAME_LEN] = 0;
+		idx_put(dir, name, slot);
+	}
+
+	sync_inode(dir);
+	return idx;
+}
+
+/*****************************************************************************
+ *                                idx_find
+ *****************************************************************************/
+/**
+ * Look a name up in the index of a directory.
+ *
+ * @param[in]  dir   I-node of the directory.
+ * @param[in]  name  Filename.
+ * @param[out] slot  Slot nr of the entry, if found.
+ *
+ * @return  The bucket holding the slot, or -1 if there is no such name.
+ *****************************************************************************/
+PRIVATE int idx_find(struct inode * dir, const char * name, int * slot)
+{
+	int dev = dir->i_dev;
+	int idx = dir->i_dir_idx;
+	int nr_buckets = (idx_hdr(dev, idx, 0)->di_nr_sects - 1) *
+		BUCKETS_PER_SECT;
+	int b = name_hash(name) % nr_buckets;
+	int i;
+
+	for (i = 0; i < nr_buckets; i++, b = (b + 1) % nr_buckets) {
+		u32 v = *idx_bucket(dev, idx, b, 0);
+		if (v == 0)
+			break;
+		if (v == DIR_IDX_TOMB)
+			continue;
+		if (name_eq(dir_slot(dir, v - 1, 0)->name, name)) {
+			*slot = v - 1;
+			return b;
+		}
+	}
+	return -1;
+}
+
+/*****************************************************************************
+ *                                idx_put
+ *****************************************************************************/
+/**
+ * Put a slot into the index of a directory, in the first bucket which is
+ * free or a tombstone. The caller makes sure there is one.
+ *
+ *****************************************************************************/
+PRIVATE void idx_put(struct inode * dir, const char * name, int slot)
+{
+	int dev = dir->i_dev;
+	int idx = dir->i_dir_idx;
+	int nr_buckets = (idx_hdr(dev, idx, 0)->di_nr_sects - 1) *
+		BUCKETS_PER_SECT;
+	int b = name_hash(name) % nr_buckets;
+	u32 v;
+
+	while ((v = *idx_bucket(dev, idx, b, 0)) != 0 && v != DIR_IDX_TOMB)
+		b = (b + 1) % nr_buckets;
+
+	*idx_bucket(dev, idx, b, 1) = slot + 1;
+
+	struct dir_index * hdr = idx_hdr(dev, idx, 1);
+	hdr->di_used++;
+	if (v == DIR_IDX_TOMB)
+		hdr->di_tomb--;
+}
@@ -83,42 +83,14 @@ PUBLIC int disklog(char * logstr)
 		 * set sector-map so that other files cannot use the log sectors
 		 */
 
-		int bits_per_sect = SECTOR_SIZE * 8; /* 4096 */
-
-		int smap_blk0_nr = 1 + 1 + sb->nr_imap_sects; /* 3 */
-		int sect_nr  = smap_blk0_nr + nr_log_blk0_nr / bits_per_sect; /* 3+9=12 */
-		int byte_off = (nr_log_blk0_nr % bits_per_sect) / 8; /* 168 */
-		int bit_off  = (nr_log_blk0_nr % bits_per_sect) % 8; /* 1 */
-		int sect_cnt = NR_SECTS_FOR_LOG / bits_per_sect + 2; /* 1 */
-		int bits_left= NR_SECTS_FOR_LOG; /* 2048 */
-
-		int i;
-		for (i = 0; i < sect_cnt; i++) {
-			DISKLOG_RD_SECT(device, sect_nr + i); /* DISKLOG_RD_SECT(?, 12) */
-
-			for (; byte_off < SECTOR_SIZE && bits_left > 0; byte_off++) {
-				for (; bit_off < 8; bit_off++) { /* repeat till enough bits are set */
-					if (((logdiskbuf[byte_off] >> bit_off) & 1) == 0)
-						logdiskbuf[byte_off] |= (1 << bit_off);
-					if (--bits_left  == 0)
-						break;
-				}
-				bit_off = 0;
-			}
-			byte_off = 0;
-			bit_off = 0;
-
-			DISKLOG_WR_SECT(device, sect_nr + i);
-
-			if (bits_left == 0)
-				break;
-		}
-		assert(bits_left == 0);
+		set_smap_bits(device, nr_log_blk0_nr - sb->n_1st_sect,
+			      NR_SECTS_FOR_LOG);
 #endif /* SET_LOG_SECT_SMAP_AT_STARTUP */
 
 		pos = 0x40;
 
 #ifdef MEMSET_LOG_SECTS
+		int i;
 		/* write padding stuff to log sectors */
 		int chunk = min(MAX_IO_BYTES, LOGDISKBUF_SIZE >> SECTOR_SIZE_SHIFT);
 		assert(chunk == 256);
@@ -296,6 +268,11 @@ PUBLIC void dump_fd_graph(const char * fmt, ...)
 
 	/* assert(getpid() == TASK_MM); */
 
+#if (LOG_SMAP == 1 || LOG_IMAP == 1 || LOG_INODE_ARRAY || LOG_ROOT_DIR == 1)
+	/* the maps, i-nodes and `/' are read from the disk below */
+	sync_all();
+#endif
+
 	printl("<|");
 
 	disable_int();
@@ -0,0 +1,271 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   extent.c
+ * @brief  Extents of regular files and directories.
+ *
+ * A file starts with no sectors at all. grow_file() allocates sectors as
+ * the file is written: it first tries to extend the last extent in place,
+ * so a file written sequentially stays contiguous, and only starts a new
+ * extent when the sectors after the last one are taken.
+ *
+ * An empty file grown to its full size at once, e.g. by ftruncate(), gets
+ * a single run if the disk has one that long. untar() relies on this for
+ * kernel.bin, since the HD loader reads it from i_start_sect on.
+ *
+ * @see struct inode
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+PRIVATE void	get_ext(struct inode * pin, int k, struct extent * e);
+PRIVATE void	set_ext(struct inode * pin, int k, struct extent * e);
+PRIVATE int	nr_exts(struct inode * pin);
+
+/*****************************************************************************
+ *                                bmap
+ *****************************************************************************/
+/**
+ * <Ring 1> Map a sector of a file to a sector of the device.
+ *
+ * @param[in]  pin    I-node of the file.
+ * @param[in]  lsect  Sector nr in the file.
+ * @param[out] run    If not 0, how many sectors from `lsect' on are
+ *                    contiguous in the device.
+ *
+ * @return  Sector nr in the device, or 0 if `lsect' is not allocated.
+ *****************************************************************************/
+PUBLIC int bmap(struct inode * pin, int lsect, int * run)
+{
+	int k;
+	struct extent e;
+
+	for (k = 0; k < NR_FILE_EXTENTS; k++) {
+		get_ext(pin, k, &e);
+		if (e.e_nr == 0)
+			break;
+		if (lsect < e.e_nr) {
+			if (run)
+				*run = e.e_nr - lsect;
+			return e.e_start + lsect;
+		}
+		lsect -= e.e_nr;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                file_sects
+ *****************************************************************************/
+/**
+ * <Ring 1> How many sectors are allocated to a file.
+ *
+ * @param pin  I-node of the file.
+ *
+ * @return  Nr of sectors.
+ *****************************************************************************/
+PUBLIC int file_sects(struct inode * pin)
+{
+	int k;
+	int n = 0;
+	struct extent e;
+
+	for (k = 0; k < NR_FILE_EXTENTS; k++) {
+		get_ext(pin, k, &e);
+		if (e.e_nr == 0)
+			break;
+		n += e.e_nr;
+	}
+
+	return n;
+}
+
+/*****************************************************************************
+ *                                grow_file
+ *****************************************************************************/
+/**
+ * <Ring 1> Make sure at least `nr_sects' sectors are allocated to a file.
+ *
+ * @param pin       I-node of the file.
+ * @param nr_sects  How many sectors are needed.
+ *
+ * @return  How many sectors the file has now. Less than `nr_sects' if the
+ *          disk is full or the file has used up its extents.
+ *****************************************************************************/
+PUBLIC int grow_file(struct inode * pin, int nr_sects)
+{
+	int have = file_sects(pin);
+	int n = nr_exts(pin);
+	struct extent e;
+
+	if (have >= nr_sects)
+		return have;
+
+	while (have < nr_sects) {
+		int need = nr_sects - have;
+
+		/* grow the last extent in place */
+		if (n > 0) {
+			get_ext(pin, n - 1, &e);
+			int got = extend_sects(pin->i_dev, e.e_start + e.e_nr,
+					       need);
+			if (got > 0) {
+				e.e_nr += got;
+				set_ext(pin, n - 1, &e);
+				have += got;
+				continue;
+			}
+		}
+
+		if (n == NR_FILE_EXTENTS)
+			break;
+
+		if (n == NR_DIRECT_EXTENTS && pin->i_ext_blk == 0) {
+			int one = 1;
+			int blk = alloc_sects(pin->i_dev, &one);
+			if (!blk)
+				break;
+			struct buf * bp = get_buf(pin->i_dev, blk, 0);
+			memset(bp->b_data, 0, SECTOR_SIZE);
+			mark_meta_dirty(bp);
+			pin->i_ext_blk = blk;
+		}
+
+		int got = need;
+		int start = alloc_sects(pin->i_dev, &got);
+		if (!start)
+			break;
+		e.e_start = start;
+		e.e_nr = got;
+		set_ext(pin, n++, &e);
+		have += got;
+	}
+
+	sync_inode(pin);
+	return have;
+}
+
+/*****************************************************************************
+ *                                shrink_file
+ *****************************************************************************/
+/**
+ * <Ring 1> Free the sectors of a file beyond the first `nr_sects'.
+ *
+ * @param pin       I-node of the file.
+ * @param nr_sects  How many sectors to keep.
+ *****************************************************************************/
+PUBLIC void shrink_file(struct inode * pin, int nr_sects)
+{
+	int k;
+	int keep = nr_sects;
+	struct extent e;
+
+	for (k = 0; k < NR_FILE_EXTENTS; k++) {
+		get_ext(pin, k, &e);
+		if (e.e_nr == 0)
+			break;
+		if (keep >= e.e_nr) {
+			keep -= e.e_nr;
+			continue;
+		}
+		free_sects(pin->i_dev, e.e_start + keep, e.e_nr - keep);
+		inval_blocks(pin->i_dev, e.e_start + keep, e.e_nr - keep);
+		e.e_nr = keep;
+		if (keep == 0)
+			e.e_start = 0;
+		set_ext(pin, k, &e);
+		keep = 0;
+	}
+
+	if (pin->i_ext_blk && nr_exts(pin) <= NR_DIRECT_EXTENTS) {
+		free_sects(pin->i_dev, pin->i_ext_blk, 1);
+		inval_blocks(pin->i_dev, pin->i_ext_blk, 1);
+		pin->i_ext_blk = 0;
+	}
+
+	sync_inode(pin);
+}
+
+/*****************************************************************************
+ *                                nr_exts
+ *****************************************************************************/
+/**
+ * How many extents a file has.
+ *
+ *****************************************************************************/
+PRIVATE int nr_exts(struct inode * pin)
+{
+	int k;
+	struct extent e;
+
+	for (k = 0; k < NR_FILE_EXTENTS; k++) {
+		get_ext(pin, k, &e);
+		if (e.e_nr == 0)
+			break;
+	}
+	return k;
+}
+
+/*****************************************************************************
+ *                                get_ext
+ *****************************************************************************/
+/**
+ * Get the k-th extent of a file. An unused one has e_nr == 0.
+ *
+ *****************************************************************************/
+PRIVATE void get_ext(struct inode * pin, int k, struct extent * e)
+{
+	if (k == 0) {
+		e->e_start = pin->i_start_sect;
+		e->e_nr = pin->i_nr_sects;
+	}
+	else if (k == 1) {
+		e->e_start = pin->i_ext_start;
+		e->e_nr = pin->i_ext_nr;
+	}
+	else if (pin->i_ext_blk == 0) {
+		e->e_start = 0;
+		e->e_nr = 0;
+	}
+	else {
+		struct buf * bp = get_buf(pin->i_dev, pin->i_ext_blk, 1);
+		*e = ((struct extent *)bp->b_data)[k - NR_DIRECT_EXTENTS];
+	}
+}
+
+/*****************************************************************************
+ *                                set_ext
+ *****************************************************************************/
+/**
+ * Set the k-th extent of a file. The caller syncs the i-node.
+ *
+ *****************************************************************************/
+PRIVATE void set_ext(struct inode * pin, int k, struct extent * e)
+{
+	if (k == 0) {
+		pin->i_start_sect = e->e_start;
+		pin->i_nr_sects = e->e_nr;
+	}
+	else if (k == 1) {
+		pin->i_ext_start = e->e_start;
+		pin->i_ext_nr = e->e_nr;
+	}
+	else {
+		assert(pin->i_ext_blk);
+		struct buf * bp = get_buf(pin->i_dev, pin->i_ext_blk, 1);
+		((struct extent *)bp->b_data)[k - NR_DIRECT_EXTENTS] = *e;
+		mark_meta_dirty(bp);
+	}
+}
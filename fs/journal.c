@@ -0,0 +1,238 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   journal.c
+ * @brief  Metadata journal.
+ *
+ * Creating a file changes the inode-map, the sector-map, an i-node and a
+ * directory, which live in different places on the disk. Rather than writing
+ * them one by one, journal_commit() writes all dirty metadata sectors in one
+ * go into the journal, which is NR_JOURNAL_SECTS sectors right below the
+ * disk log, then marks the transaction committed in the journal header, and
+ * only then writes the sectors home. If FS dies in between, replay_journal()
+ * finishes the job at the next mount, so the disk never needs a full check.
+ *
+ * A transaction holds at most NR_JNL_BATCH sectors; more dirty metadata than
+ * that is committed in several transactions.
+ *
+ * @see struct journal_header
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+PRIVATE int	jnl_dev = NO_DEV;	/**< NO_DEV: metadata is written in
+					 *   place */
+PRIVATE int	jnl_start;		/**< The header sector */
+PRIVATE u32	jnl_seq;
+PRIVATE u8	jnl_hdr[SECTOR_SIZE];
+
+PRIVATE int	journal_base(int dev);
+PRIVATE void	read_header(int dev, int start);
+PRIVATE void	write_header(int dev, int start, u32 seq, int nr, u32 sum);
+PRIVATE u32	jnl_sum(u8 * p, int bytes);
+
+/*****************************************************************************
+ *                                replay_journal
+ *****************************************************************************/
+/**
+ * <Ring 1> Write home the sectors of a committed transaction left in the
+ * journal by a crash. Must be called before anything else is read from the
+ * device, but after its super block.
+ *
+ * @param dev  The device.
+ *****************************************************************************/
+PUBLIC void replay_journal(int dev)
+{
+	int start = journal_base(dev);
+	struct journal_header * h = (struct journal_header *)jnl_hdr;
+
+	read_header(dev, start);
+	if (h->j_magic != JOURNAL_MAGIC || h->j_nr == 0)
+		return;
+
+	u32 seq = h->j_seq;
+	int nr = h->j_nr;
+	u32 sum = h->j_sum;
+
+	if (nr <= NR_JNL_BATCH) {
+		rw_sector(DEV_READ, dev, (u64)(start + 1) * SECTOR_SIZE,
+			  (nr + 1) * SECTOR_SIZE, TASK_FS, jnlbuf);
+	}
+	if (nr > NR_JNL_BATCH || jnl_sum(jnlbuf, (nr + 1) * SECTOR_SIZE) != sum) {
+		printl("{FS} journal: transaction %d is torn, dropped\n", seq);
+	}
+	else {
+		u32 * desc = (u32 *)jnlbuf;
+		int i;
+		for (i = 0; i < nr; i++) {
+			rw_sector(DEV_WRITE, dev, (u64)desc[i] * SECTOR_SIZE,
+				  SECTOR_SIZE, TASK_FS,
+				  jnlbuf + (i + 1) * SECTOR_SIZE);
+			inval_blocks(dev, desc[i], 1);
+		}
+		printl("{FS} journal: replayed %d sectors of transaction %d\n",
+		       nr, seq);
+	}
+
+	write_header(dev, start, seq, 0, 0);
+}
+
+/*****************************************************************************
+ *                                init_journal
+ *****************************************************************************/
+/**
+ * <Ring 1> Start journaling metadata of the device. The first time, the
+ * journal sectors are taken from the sector-map; if they are used by some
+ * file, metadata keeps being written in place.
+ *
+ * @param dev  The device. Its bitmaps must have been loaded.
+ *****************************************************************************/
+PUBLIC void init_journal(int dev)
+{
+	int start = journal_base(dev);
+	struct journal_header * h = (struct journal_header *)jnl_hdr;
+
+	read_header(dev, start);
+	if (h->j_magic == JOURNAL_MAGIC) {
+		/* ours already, make sure the sector-map agrees */
+		set_smap_bits(dev, start - get_super_block(dev)->n_1st_sect,
+			      NR_JOURNAL_SECTS);
+		jnl_seq = h->j_seq + 1;
+	}
+	else {
+		int got = extend_sects(dev, start, NR_JOURNAL_SECTS);
+		if (got < NR_JOURNAL_SECTS) {
+			if (got)
+				free_sects(dev, start, got);
+			printl("{FS} journal: sectors 0x%x~ are in use, "
+			       "journaling is off\n", start);
+			return;
+		}
+		jnl_seq = 0;
+		write_header(dev, start, jnl_seq, 0, 0);
+	}
+
+	jnl_dev = dev;
+	jnl_start = start;
+}
+
+/*****************************************************************************
+ *                                journal_commit
+ *****************************************************************************/
+/**
+ * <Ring 1> Write all dirty metadata in the buffer cache to the disk, through
+ * the journal if it is on.
+ *
+ *****************************************************************************/
+PUBLIC void journal_commit()
+{
+	struct buf * list[NR_JNL_BATCH];
+	int n;
+
+	while ((n = dirty_meta_bufs(list, NR_JNL_BATCH)) > 0) {
+		int i;
+
+		if (jnl_dev == NO_DEV) {
+			for (i = 0; i < n; i++)
+				write_buf(list[i]);
+			continue;
+		}
+
+		u32 * desc = (u32 *)jnlbuf;
+		memset(jnlbuf, 0, SECTOR_SIZE);
+		for (i = 0; i < n; i++) {
+			assert(list[i]->b_dev == jnl_dev);
+			desc[i] = list[i]->b_nr;
+			memcpy(jnlbuf + (i + 1) * SECTOR_SIZE, list[i]->b_data,
+			       SECTOR_SIZE);
+		}
+
+		/* the transaction, then the commit record */
+		rw_sector(DEV_WRITE, jnl_dev,
+			  (u64)(jnl_start + 1) * SECTOR_SIZE,
+			  (n + 1) * SECTOR_SIZE, TASK_FS, jnlbuf);
+		write_header(jnl_dev, jnl_start, jnl_seq, n,
+			     jnl_sum(jnlbuf, (n + 1) * SECTOR_SIZE));
+
+		/* now the sectors can go home */
+		for (i = 0; i < n; i++)
+			write_buf(list[i]);
+		write_header(jnl_dev, jnl_start, jnl_seq, 0, 0);
+		jnl_seq++;
+	}
+}
+
+/*****************************************************************************
+ *                                journal_base
+ *****************************************************************************/
+/**
+ * The header sector of the journal of a device.
+ *
+ *****************************************************************************/
+PRIVATE int journal_base(int dev)
+{
+	return get_super_block(dev)->nr_sects - NR_SECTS_FOR_LOG -
+		NR_JOURNAL_SECTS;
+}
+
+/*****************************************************************************
+ *                                read_header
+ *****************************************************************************/
+/**
+ * Read the journal header into jnl_hdr.
+ *
+ *****************************************************************************/
+PRIVATE void read_header(int dev, int start)
+{
+	rw_sector(DEV_READ, dev, (u64)start * SECTOR_SIZE, SECTOR_SIZE,
+		  TASK_FS, jnl_hdr);
+}
+
+/*****************************************************************************
+ *                                write_header
+ *****************************************************************************/
+/**
+ * Write the journal header. A header with `nr' != 0 is the commit record of
+ * a transaction.
+ *
+ *****************************************************************************/
+PRIVATE void write_header(int dev, int start, u32 seq, int nr, u32 sum)
+{
+	struct journal_header * h = (struct journal_header *)jnl_hdr;
+
+	memset(jnl_hdr, 0, SECTOR_SIZE);
+	h->j_magic = JOURNAL_MAGIC;
+	h->j_seq = seq;
+	h->j_nr = nr;
+	h->j_sum = sum;
+	rw_sector(DEV_WRITE, dev, (u64)start * SECTOR_SIZE, SECTOR_SIZE,
+		  TASK_FS, jnl_hdr);
+}
+
+/*****************************************************************************
+ *                                jnl_sum
+ *****************************************************************************/
+/**
+ * Checksum of a transaction, so that a torn one is not replayed.
+ *
+ *****************************************************************************/
+PRIVATE u32 jnl_sum(u8 * p, int bytes)
+{
+	u32 sum = 0;
+	u32 * w = (u32 *)p;
+	int i;
+	for (i = 0; i < bytes / 4; i++)
+		sum = ((sum << 1) | (sum >> 31)) + w[i];
+	return sum;
+}
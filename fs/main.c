@@ -27,6 +27,17 @@ PRIVATE void mkfs();
 PRIVATE void read_super_block(int dev);
 PRIVATE int fs_fork();
 PRIVATE int fs_exit();
+PRIVATE void init_icache();
+PRIVATE void write_inode(struct inode * p);
+PRIVATE void inode_unhash(struct inode * p);
+PRIVATE void ilru_unlink(struct inode * p);
+PRIVATE void ilru_append(struct inode * p);
+
+#define	INODE_HASH(dev,num)	(((u32)(dev) * 31 + (u32)(num)) % NR_INODE_HASH)
+
+PRIVATE struct inode *	inode_hash[NR_INODE_HASH];
+PRIVATE struct inode	ilru;	/**< unreferenced slots of inode_table[],
+				 *   least recently used first */
 
 /*****************************************************************************
  *                                task_fs
@@ -42,16 +53,25 @@ PUBLIC void task_fs()
 	init_fs();
 
 	while (1) {
-		send_recv(RECEIVE, ANY, &fs_msg);
+		/* first the parked requests which can go on */
+		run_parked();
+
+		if (!next_deferred(&fs_msg)) {
+			send_recv(RECEIVE, ANY, &fs_msg);
+			if (io_reply(&fs_msg))
+				continue;
+		}
 
 		int msgtype = fs_msg.type;
 		int src = fs_msg.source;
-		pcaller = &proc_table[src];
+		/* threads share the file descriptors of their group leader */
+		pcaller = &proc_table[proc_table[src].p_tgid];
 
 		switch (msgtype) {
 		case OPEN:
 			fs_msg.FD = do_open();
-			log_fs_event(msgtype, src, fs_msg.FD);
+			if (fs_msg.type != SUSPEND_PROC)
+				log_fs_event(msgtype, src, fs_msg.FD);
 			break;
 		case CLOSE:
 			fs_msg.RETVAL = do_close();
@@ -60,7 +80,8 @@ PUBLIC void task_fs()
 		case READ:
 		case WRITE:
 			fs_msg.CNT = do_rdwt();
-			log_fs_event(msgtype, src, fs_msg.CNT);
+			if (fs_msg.type != SUSPEND_PROC) /* else when it's done */
+				log_fs_event(msgtype, src, fs_msg.CNT);
 			break;
 		case UNLINK:
 			fs_msg.RETVAL = do_unlink();
@@ -85,7 +106,8 @@ PUBLIC void task_fs()
 			break;
 		case EXIT:
 			fs_msg.RETVAL = fs_exit();
-			log_fs_event(msgtype, src, fs_msg.RETVAL);
+			if (fs_msg.type != SUSPEND_PROC)
+				log_fs_event(msgtype, src, fs_msg.RETVAL);
 			break;
 		case LSEEK:
 			fs_msg.OFFSET = do_lseek();
@@ -95,10 +117,44 @@ PUBLIC void task_fs()
 			fs_msg.RETVAL = do_stat();
 			log_fs_event(msgtype, src, fs_msg.RETVAL);
 			break;
+		case FSTAT:
+			fs_msg.RETVAL = do_fstat();
+			log_fs_event(msgtype, src, fs_msg.RETVAL);
+			break;
 		case TRUNCATE:
 			fs_msg.RETVAL = do_truncate();
+			if (fs_msg.type != SUSPEND_PROC)
+				log_fs_event(msgtype, src, fs_msg.RETVAL);
+			break;
+		case MKDIR:
+			fs_msg.RETVAL = do_mkdir();
+			log_fs_event(msgtype, src, fs_msg.RETVAL);
+			break;
+		case SYNC:
+			fs_msg.RETVAL = do_sync();
+			break;
+		case FSYNC:
+			fs_msg.RETVAL = do_fsync();
 			log_fs_event(msgtype, src, fs_msg.RETVAL);
 			break;
+		case COPY_RANGE:
+			fs_msg.CNT = do_copy_range();
+			if (fs_msg.type != SUSPEND_PROC)
+				log_fs_event(msgtype, src, fs_msg.CNT);
+			break;
+		case READDIR:
+			fs_msg.RETVAL = do_readdir();
+			log_fs_event(msgtype, src, fs_msg.RETVAL);
+			break;
+		case FMAP_OPEN:
+			fs_msg.RETVAL = do_fmap_open();
+			break;
+		case FMAP_WRITE:
+			fs_msg.RETVAL = do_fmap_write();
+			break;
+		case FMAP_CLOSE:
+			fs_msg.RETVAL = do_fmap_close();
+			break;
 		default:
 			dump_msg("FS::unknown message:", &fs_msg);
 			log_fs_event(msgtype, src, -1);
@@ -118,7 +174,16 @@ PUBLIC void task_fs()
 		msg_name[FORK]   = "FORK";
 		msg_name[EXIT]   = "EXIT";
 		msg_name[STAT]   = "STAT";
+		msg_name[FSTAT]  = "FSTAT";
 		msg_name[TRUNCATE] = "TRUNCATE";
+		msg_name[MKDIR]  = "MKDIR";
+		msg_name[SYNC]   = "SYNC";
+		msg_name[FSYNC]  = "FSYNC";
+		msg_name[COPY_RANGE] = "COPY_RANGE";
+		msg_name[READDIR]    = "READDIR";
+		msg_name[FMAP_OPEN]  = "FMAP_OPEN";
+		msg_name[FMAP_WRITE] = "FMAP_WRITE";
+		msg_name[FMAP_CLOSE] = "FMAP_CLOSE";
 		// msg_name[CALC_CHECKSUM] = "CALC_CHECKSUM";
 		msg_name[VERIFY_CHECKSUM] = "VERIFY_CHECKSUM";
 		msg_name[REFRESH_CHECKSUMS] = "REFRESH_CHECKSUMS";
@@ -136,7 +201,16 @@ PUBLIC void task_fs()
 		case EXIT:
 		case LSEEK:
 		case STAT:
+		case FSTAT:
 		case TRUNCATE:
+		case MKDIR:
+		case SYNC:
+		case FSYNC:
+		case COPY_RANGE:
+		case READDIR:
+		case FMAP_OPEN:
+		case FMAP_WRITE:
+		case FMAP_CLOSE:
 			break;
 		case RESUME_PROC:
 			break;
@@ -173,14 +247,16 @@ PRIVATE void init_fs()
 		memset(&f_desc_table[i], 0, sizeof(struct file_desc));
 
 	/* inode_table[] */
-	for (i = 0; i < NR_INODE; i++)
-		memset(&inode_table[i], 0, sizeof(struct inode));
+	init_icache();
 
 	/* super_block[] */
 	struct super_block * sb = super_block;
 	for (; sb < &super_block[NR_SUPER_BLOCK]; sb++)
 		sb->sb_dev = NO_DEV;
 
+	init_bcache();
+	init_dcache();
+
 	/* open the device: hard disk */
 	MESSAGE driver_msg;
 	driver_msg.type = DEV_OPEN;
@@ -199,6 +275,7 @@ PRIVATE void init_fs()
 		printl("{FS} mkfs (magic=0x%x inode_size=%d expect=%d)\n",
 			   sb->magic, sb->inode_size, INODE_SIZE);
 		mkfs();
+		journal_commit();	/* the journal is not on yet */
 	}
 
 	/* load super block of ROOT */
@@ -207,6 +284,10 @@ PRIVATE void init_fs()
 	sb = get_super_block(ROOT_DEV);
 	assert(sb->magic == MAGIC_V1);
 
+	replay_journal(ROOT_DEV);
+	load_bitmaps(ROOT_DEV);
+	init_journal(ROOT_DEV);
+
 	root_inode = get_inode(ROOT_DEV, ROOT_INODE);
 }
 
@@ -222,6 +303,7 @@ PRIVATE void init_fs()
  *          - Create the sector map
  *          - Create the inodes of the files
  *          - Create `/', the root directory
+ *          - Clear the journal header
  *****************************************************************************/
 PRIVATE void mkfs()
 {
@@ -325,7 +407,7 @@ PRIVATE void mkfs()
 	assert(INSTALL_START_SECT + INSTALL_NR_SECTS < 
 	       sb.nr_sects - NR_SECTS_FOR_LOG);
 	int bit_offset = INSTALL_START_SECT -
-		sb.n_1st_sect + 1; /* sect M <-> bit (M - sb.n_1stsect + 1) */
+		sb.n_1st_sect; /* sect M <-> bit (M - sb.n_1stsect) */
 	int bit_off_in_sect = bit_offset % (SECTOR_SIZE * 8);
 	int bit_left = INSTALL_NR_SECTS;
 	int cur_sect = bit_offset / (SECTOR_SIZE * 8);
@@ -393,6 +475,13 @@ PRIVATE void mkfs()
 	(++pde)->inode_nr = NR_CONSOLES + 2;
 	sprintf(pde->name, "cmd.tar", i);
 	WR_SECT(ROOT_DEV, sb.n_1st_sect);
+
+	/************************/
+	/*       journal        */
+	/************************/
+	/* whatever an old FS left there must not be replayed */
+	memset(fsbuf, 0, SECTOR_SIZE);
+	WR_SECT(ROOT_DEV, sb.nr_sects - NR_SECTS_FOR_LOG - NR_JOURNAL_SECTS);
 }
 
 /*****************************************************************************
@@ -422,6 +511,7 @@ PUBLIC int rw_sector(int io_type, int dev, u64 pos, int bytes, int proc_nr,
 	driver_msg.CNT		= bytes;
 	driver_msg.PROC_NR	= proc_nr;
 	assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
+	wait_io();
 	send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &driver_msg);
 
 	return 0;
@@ -440,16 +530,8 @@ PUBLIC int rw_sector(int io_type, int dev, u64 pos, int bytes, int proc_nr,
 PRIVATE void read_super_block(int dev)
 {
 	int i;
-	MESSAGE driver_msg;
 
-	driver_msg.type		= DEV_READ;
-	driver_msg.DEVICE	= MINOR(dev);
-	driver_msg.POSITION	= SECTOR_SIZE * 1;
-	driver_msg.BUF		= fsbuf;
-	driver_msg.CNT		= SECTOR_SIZE;
-	driver_msg.PROC_NR	= TASK_FS;
-	assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
-	send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &driver_msg);
+	RD_SECT(dev, 1);
 
 	/* find a free slot in super_block[] */
 	for (i = 0; i < NR_SUPER_BLOCK; i++)
@@ -490,6 +572,28 @@ PUBLIC struct super_block * get_super_block(int dev)
 }
 
 
+/*****************************************************************************
+ *                                init_icache
+ *****************************************************************************/
+/**
+ * <Ring 1> Empty the hash table of inode_table[] and put every slot on the
+ * LRU list.
+ * 
+ *****************************************************************************/
+PRIVATE void init_icache()
+{
+	int i;
+
+	ilru.i_next = ilru.i_prev = &ilru;
+	for (i = 0; i < NR_INODE_HASH; i++)
+		inode_hash[i] = 0;
+
+	for (i = 0; i < NR_INODE; i++) {
+		memset(&inode_table[i], 0, sizeof(struct inode));
+		ilru_append(&inode_table[i]);
+	}
+}
+
 /*****************************************************************************
  *                                get_inode
  *****************************************************************************/
@@ -497,6 +601,9 @@ PUBLIC struct super_block * get_super_block(int dev)
  * <Ring 1> Get the inode ptr of given inode nr. A cache -- inode_table[] -- is
  * maintained to make things faster. If the inode requested is already there,
  * just return it. Otherwise the inode will be read from the disk.
+ *
+ * The cache is hashed by (dev, num). Unreferenced inodes stay in it, on an
+ * LRU list, until their slot is needed by another one.
  * 
  * @param dev Device nr.
  * @param num I-node nr.
@@ -509,28 +616,36 @@ PUBLIC struct inode * get_inode(int dev, int num)
 	if (num == 0)
 		return 0;
 
-	struct inode * p;
-	struct inode * q = 0;
-	for (p = &inode_table[0]; p < &inode_table[NR_INODE]; p++) {
-		if (p->i_cnt) {	/* not a free slot */
-			if ((p->i_dev == dev) && (p->i_num == num)) {
-				/* this is the inode we want */
-				p->i_cnt++;
-				return p;
-			}
-		}
-		else {		/* a free slot */
-			if (!q) /* q hasn't been assigned yet */
-				q = p; /* q <- the 1st free slot */
+	int h = INODE_HASH(dev, num);
+	struct inode * q;
+	for (q = inode_hash[h]; q; q = q->i_hnext) {
+		if ((q->i_dev == dev) && (q->i_num == num)) {
+			/* this is the inode we want */
+			if (q->i_cnt++ == 0)
+				ilru_unlink(q);
+			return q;
 		}
 	}
 
-	if (!q)
+	/* reuse the least recently used unreferenced slot */
+	q = ilru.i_next;
+	if (q == &ilru)
 		panic("the inode table is full");
+	ilru_unlink(q);
+	if (q->i_num) {
+		if (q->i_dirty)
+			write_inode(q);
+		inode_unhash(q);
+	}
 
 	q->i_dev = dev;
 	q->i_num = num;
 	q->i_cnt = 1;
+	q->i_dirty = 0;
+	q->i_gen = 1;
+	q->i_ck_gen = 0;
+	q->i_hnext = inode_hash[h];
+	inode_hash[h] = q;
 
 	struct super_block * sb = get_super_block(dev);
 	// 计算inode在磁盘中的扇区号
@@ -545,6 +660,10 @@ PUBLIC struct inode * get_inode(int dev, int num)
 	q->i_size = pinode->i_size;
 	q->i_start_sect = pinode->i_start_sect;
 	q->i_nr_sects = pinode->i_nr_sects;
+	q->i_ext_start = pinode->i_ext_start;
+	q->i_ext_nr = pinode->i_ext_nr;
+	q->i_ext_blk = pinode->i_ext_blk;
+	q->i_dir_idx = pinode->i_dir_idx;
 	memcpy(q->md5_checksum, pinode->md5_checksum, MD5_HASH_LEN);
 	// q->checksum_key = 0; /* key no longer stored on disk */
 	return q;
@@ -555,28 +674,58 @@ PUBLIC struct inode * get_inode(int dev, int num)
  *****************************************************************************/
 /**
  * Decrease the reference nr of a slot in inode_table[]. When the nr reaches
- * zero, it means the inode is not used any more and can be overwritten by
- * a new inode.
+ * zero, the inode goes to the tail of the LRU list: it is kept (dirty or
+ * not) until the slot is needed by another inode.
  * 
  * @param pinode I-node ptr.
  *****************************************************************************/
 PUBLIC void put_inode(struct inode * pinode)
 {
 	assert(pinode->i_cnt > 0);
-	pinode->i_cnt--;
+	if (--pinode->i_cnt == 0)
+		ilru_append(pinode);
 }
 
 /*****************************************************************************
  *                                sync_inode
  *****************************************************************************/
 /**
- * <Ring 1> Write the inode back to the disk. Commonly invoked as soon as the
- *          inode is changed.
+ * <Ring 1> Mark the inode dirty. Commonly invoked as soon as the inode is
+ *          changed. It reaches the disk when sync_inodes() runs or when its
+ *          slot is reused.
+ * 
+ * @param p I-node ptr.
+ *****************************************************************************/
+PUBLIC void sync_inode(struct inode * p)
+{
+	p->i_dirty = 1;
+}
+
+/*****************************************************************************
+ *                                sync_inodes
+ *****************************************************************************/
+/**
+ * <Ring 1> Write all dirty inodes back.
+ * 
+ *****************************************************************************/
+PUBLIC void sync_inodes()
+{
+	struct inode * p;
+	for (p = &inode_table[0]; p < &inode_table[NR_INODE]; p++)
+		if (p->i_dirty)
+			write_inode(p);
+}
+
+/*****************************************************************************
+ *                                write_inode
+ *****************************************************************************/
+/**
+ * <Ring 1> Write the inode into its sector.
  * 
  * @param p I-node ptr.
  *****************************************************************************/
 // 将inode信息写入磁盘：根据inode号求出其在磁盘inode表中的扇区，将该扇区读到缓冲区，在对应偏移处更新数据，再写回
- PUBLIC void sync_inode(struct inode * p)
+PRIVATE void write_inode(struct inode * p)
 {
 	struct inode * pinode;
 	struct super_block * sb = get_super_block(p->i_dev);
@@ -590,9 +739,53 @@ PUBLIC void put_inode(struct inode * pinode)
 	pinode->i_size = p->i_size;
 	pinode->i_start_sect = p->i_start_sect;
 	pinode->i_nr_sects = p->i_nr_sects;
+	pinode->i_ext_start = p->i_ext_start;
+	pinode->i_ext_nr = p->i_ext_nr;
+	pinode->i_ext_blk = p->i_ext_blk;
+	pinode->i_dir_idx = p->i_dir_idx;
 	memcpy(pinode->md5_checksum, p->md5_checksum, MD5_HASH_LEN);
 	// pinode->checksum_key = 0; /* never persist key */
 	WR_SECT(p->i_dev, blk_nr);
+	p->i_dirty = 0;
+}
+
+/*****************************************************************************
+ *                                inode_unhash
+ *****************************************************************************/
+/**
+ * Take an inode off its hash chain.
+ * 
+ *****************************************************************************/
+PRIVATE void inode_unhash(struct inode * p)
+{
+	int h = INODE_HASH(p->i_dev, p->i_num);
+	if (inode_hash[h] == p) {
+		inode_hash[h] = p->i_hnext;
+	}
+	else {
+		struct inode * q = inode_hash[h];
+		for (; q; q = q->i_hnext) {
+			if (q->i_hnext == p) {
+				q->i_hnext = p->i_hnext;
+				break;
+			}
+		}
+	}
+	p->i_hnext = 0;
+}
+
+PRIVATE void ilru_unlink(struct inode * p)
+{
+	p->i_prev->i_next = p->i_next;
+	p->i_next->i_prev = p->i_prev;
+}
+
+PRIVATE void ilru_append(struct inode * p)
+{
+	p->i_next = &ilru;
+	p->i_prev = ilru.i_prev;
+	ilru.i_prev->i_next = p;
+	ilru.i_prev = p;
 }
 
 /*****************************************************************************
@@ -622,7 +815,8 @@ PRIVATE int fs_fork()
  *                                fs_exit
  *****************************************************************************/
 /**
- * Perform the aspects of exit() that relate to files.
+ * Perform the aspects of exit() that relate to files. For a thread there
+ * is nothing but its parked requests to forget.
  * 
  * @return Zero if success.
  *****************************************************************************/
@@ -630,10 +824,23 @@ PRIVATE int fs_exit()
 {
 	int i;
 	struct proc* p = &proc_table[fs_msg.PID];
+
+	/* the file descs are held by its parked requests, if any, and its
+	 * proc_table[] slot must not be reused before they are gone. Doing
+	 * cancel_parked() again when the message is retried does no harm. */
+	if (cancel_parked(fs_msg.PID)) {
+		defer_msg();
+		return 0;
+	}
+
+	/* a thread uses the file descs of its group leader */
+	if (p->p_tgid != fs_msg.PID)
+		return 0;
+
 	for (i = 0; i < NR_FILES; i++) {
 		if (p->filp[i]) {
 			/* release the inode */
-			p->filp[i]->fd_inode->i_cnt--;
+			put_inode(p->filp[i]->fd_inode);
 			/* release the file desc slot */
 			if (--p->filp[i]->fd_cnt == 0)
 				p->filp[i]->fd_inode = 0;
@@ -1,4 +1,5 @@
 #include "type.h"
+#include "config.h"
 #include "stdio.h"
 #include "const.h"
 #include "protect.h"
@@ -11,6 +12,7 @@
 #include "keyboard.h"
 #include "proto.h"
 #include "hd.h"
+#include "hash.h"
 
 #include "sys/cmd_whitelist.h"
 
@@ -19,6 +21,10 @@
 PRIVATE int s_ck_inited = 0;
 PRIVATE u32 s_ck_key = 0;
 
+PRIVATE int ck_take(int dev, int num);
+PRIVATE int ck_refresh(struct inode * pin);
+PRIVATE void fill_stat(struct inode * pin, struct stat * s);
+
 PRIVATE void ensure_checksum_key_inited(void)
 {
 	if (!s_ck_inited) {
@@ -29,239 +35,203 @@ PRIVATE void ensure_checksum_key_inited(void)
 }
 
 
-// MD5 实现
-typedef struct {
-	u32 state[4];
-	u32 count[2];
-	u8  buffer[64];
-} MD5_CTX;
-
-#define S11 7
-#define S12 12
-#define S13 17
-#define S14 22
-#define S21 5
-#define S22 9
-#define S23 14
-#define S24 20
-#define S31 4
-#define S32 11
-#define S33 16
-#define S34 23
-#define S41 6
-#define S42 10
-#define S43 15
-#define S44 21
-
-#define F(x, y, z) (((x) & (y)) | ((~x) & (z)))
-#define G(x, y, z) (((x) & (z)) | ((y) & (~z)))
-#define H(x, y, z) ((x) ^ (y) ^ (z))
-#define I(x, y, z) ((y) ^ ((x) | (~z)))
-#define ROTATE_LEFT(x, n) (((x) << (n)) | ((x) >> (32-(n))))
-
-#define FF(a, b, c, d, x, s, ac) { \
-	(a) += F((b), (c), (d)) + (x) + (u32)(ac); \
-	(a) = ROTATE_LEFT((a), (s)); \
-	(a) += (b); \
-}
-#define GG(a, b, c, d, x, s, ac) { \
-	(a) += G((b), (c), (d)) + (x) + (u32)(ac); \
-	(a) = ROTATE_LEFT((a), (s)); \
-	(a) += (b); \
-}
-#define HH(a, b, c, d, x, s, ac) { \
-	(a) += H((b), (c), (d)) + (x) + (u32)(ac); \
-	(a) = ROTATE_LEFT((a), (s)); \
-	(a) += (b); \
-}
-#define II(a, b, c, d, x, s, ac) { \
-	(a) += I((b), (c), (d)) + (x) + (u32)(ac); \
-	(a) = ROTATE_LEFT((a), (s)); \
-	(a) += (b); \
-}
-
-PRIVATE u8 PADDING[64] = {
-	0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
-};
+PRIVATE char hex_chars[] = "0123456789abcdef";
 
-PRIVATE void md5_encode(u8 *output, u32 *input, unsigned int len)
+PRIVATE void bytes_to_hex(u8 *bytes, int len, char *hex_str)
 {
-	unsigned int i, j;
-	for (i = 0, j = 0; j < len; i++, j += 4) {
-		output[j]     = (u8)(input[i] & 0xff);
-		output[j + 1] = (u8)((input[i] >> 8) & 0xff);
-		output[j + 2] = (u8)((input[i] >> 16) & 0xff);
-		output[j + 3] = (u8)((input[i] >> 24) & 0xff);
+	int i;
+	for (i = 0; i < len; i++) {
+		hex_str[i * 2]     = hex_chars[(bytes[i] >> 4) & 0x0F];
+		hex_str[i * 2 + 1] = hex_chars[bytes[i] & 0x0F];
 	}
+	hex_str[len * 2] = '\0';
 }
 
-PRIVATE void md5_decode(u32 *output, u8 *input, unsigned int len)
-{
-	unsigned int i, j;
-	for (i = 0, j = 0; j < len; i++, j += 4) {
-		output[i] = ((u32)input[j]) |
-			    (((u32)input[j + 1]) << 8) |
-			    (((u32)input[j + 2]) << 16) |
-			    (((u32)input[j + 3]) << 24);
-	}
-}
+/*****************************************************************************
+ *                                hash trees
+ *****************************************************************************
+ * md5_checksum is the root of a hash tree over the data of the file. The
+ * data is cut into HT_MAX_LEAVES leaves of leaf_sects() sectors each, and
+ * with H the keyed CHECKSUM_HASH,
+ *
+ *     leaf k  = H(k || data of the leaf)    (zeroes past the end)
+ *     node n  = H(node 2n || node 2n+1)
+ *     root    = H(size || sectors per leaf || node 1)
+ *
+ * The trees of the last NR_HASH_TREES files hashed are kept in htbuf. A
+ * write only marks the leaves it touches (ht_dirty()), and the next hash of
+ * the file rehashes those leaves and their paths to the root.
+ *****************************************************************************/
 
-PRIVATE void md5_transform(u32 state[4], u8 block[64])
-{
-	u32 a = state[0], b = state[1], c = state[2], d = state[3], x[16];
-
-	md5_decode(x, block, 64);
-
-	FF(a, b, c, d, x[ 0], S11, 0xd76aa478);
-	FF(d, a, b, c, x[ 1], S12, 0xe8c7b756);
-	FF(c, d, a, b, x[ 2], S13, 0x242070db);
-	FF(b, c, d, a, x[ 3], S14, 0xc1bdceee);
-	FF(a, b, c, d, x[ 4], S11, 0xf57c0faf);
-	FF(d, a, b, c, x[ 5], S12, 0x4787c62a);
-	FF(c, d, a, b, x[ 6], S13, 0xa8304613);
-	FF(b, c, d, a, x[ 7], S14, 0xfd469501);
-	FF(a, b, c, d, x[ 8], S11, 0x698098d8);
-	FF(d, a, b, c, x[ 9], S12, 0x8b44f7af);
-	FF(c, d, a, b, x[10], S13, 0xffff5bb1);
-	FF(b, c, d, a, x[11], S14, 0x895cd7be);
-	FF(a, b, c, d, x[12], S11, 0x6b901122);
-	FF(d, a, b, c, x[13], S12, 0xfd987193);
-	FF(c, d, a, b, x[14], S13, 0xa679438e);
-	FF(b, c, d, a, x[15], S14, 0x49b40821);
-
-	GG(a, b, c, d, x[ 1], S21, 0xf61e2562);
-	GG(d, a, b, c, x[ 6], S22, 0xc040b340);
-	GG(c, d, a, b, x[11], S23, 0x265e5a51);
-	GG(b, c, d, a, x[ 0], S24, 0xe9b6c7aa);
-	GG(a, b, c, d, x[ 5], S21, 0xd62f105d);
-	GG(d, a, b, c, x[10], S22, 0x02441453);
-	GG(c, d, a, b, x[15], S23, 0xd8a1e681);
-	GG(b, c, d, a, x[ 4], S24, 0xe7d3fbc8);
-	GG(a, b, c, d, x[ 9], S21, 0x21e1cde6);
-	GG(d, a, b, c, x[14], S22, 0xc33707d6);
-	GG(c, d, a, b, x[ 3], S23, 0xf4d50d87);
-	GG(b, c, d, a, x[ 8], S24, 0x455a14ed);
-	GG(a, b, c, d, x[13], S21, 0xa9e3e905);
-	GG(d, a, b, c, x[ 2], S22, 0xfcefa3f8);
-	GG(c, d, a, b, x[ 7], S23, 0x676f02d9);
-	GG(b, c, d, a, x[12], S24, 0x8d2a4c8a);
-
-	HH(a, b, c, d, x[ 5], S31, 0xfffa3942);
-	HH(d, a, b, c, x[ 8], S32, 0x8771f681);
-	HH(c, d, a, b, x[11], S33, 0x6d9d6122);
-	HH(b, c, d, a, x[14], S34, 0xfde5380c);
-	HH(a, b, c, d, x[ 1], S31, 0xa4beea44);
-	HH(d, a, b, c, x[ 4], S32, 0x4bdecfa9);
-	HH(c, d, a, b, x[ 7], S33, 0xf6bb4b60);
-	HH(b, c, d, a, x[10], S34, 0xbebfbc70);
-	HH(a, b, c, d, x[13], S31, 0x289b7ec6);
-	HH(d, a, b, c, x[ 0], S32, 0xeaa127fa);
-	HH(c, d, a, b, x[ 3], S33, 0xd4ef3085);
-	HH(b, c, d, a, x[ 6], S34, 0x04881d05);
-	HH(a, b, c, d, x[ 9], S31, 0xd9d4d039);
-	HH(d, a, b, c, x[12], S32, 0xe6db99e5);
-	HH(c, d, a, b, x[15], S33, 0x1fa27cf8);
-	HH(b, c, d, a, x[ 2], S34, 0xc4ac5665);
-
-	II(a, b, c, d, x[ 0], S41, 0xf4292244);
-	II(d, a, b, c, x[ 7], S42, 0x432aff97);
-	II(c, d, a, b, x[14], S43, 0xab9423a7);
-	II(b, c, d, a, x[ 5], S44, 0xfc93a039);
-	II(a, b, c, d, x[12], S41, 0x655b59c3);
-	II(d, a, b, c, x[ 3], S42, 0x8f0ccc92);
-	II(c, d, a, b, x[10], S43, 0xffeff47d);
-	II(b, c, d, a, x[ 1], S44, 0x85845dd1);
-	II(a, b, c, d, x[ 8], S41, 0x6fa87e4f);
-	II(d, a, b, c, x[15], S42, 0xfe2ce6e0);
-	II(c, d, a, b, x[ 6], S43, 0xa3014314);
-	II(b, c, d, a, x[13], S44, 0x4e0811a1);
-	II(a, b, c, d, x[ 4], S41, 0xf7537e82);
-	II(d, a, b, c, x[11], S42, 0xbd3af235);
-	II(c, d, a, b, x[ 2], S43, 0x2ad7d2bb);
-	II(b, c, d, a, x[ 9], S44, 0xeb86d391);
-
-	state[0] += a;
-	state[1] += b;
-	state[2] += c;
-	state[3] += d;
-
-	memset((char*)x, 0, sizeof(x));
-}
+PRIVATE struct hash_tree *	hash_trees;	/**< NR_HASH_TREES in htbuf */
+PRIVATE u32			ht_clock;	/**< For the LRU */
+
+#define	HT_NODE_DIRTY(t,n)	((t)->t_dirty[(n) >> 3] & (1 << ((n) & 7)))
+#define	HT_MARK_NODE(t,n)	((t)->t_dirty[(n) >> 3] |= (1 << ((n) & 7)))
+#define	HT_CLEAR_NODE(t,n)	((t)->t_dirty[(n) >> 3] &= ~(1 << ((n) & 7)))
 
-PRIVATE void md5_init(MD5_CTX *context)
+/*****************************************************************************
+ *                                leaf_sects
+ *****************************************************************************/
+/**
+ * How many sectors a leaf of a file covers: HT_LEAF_SECTS, doubled until
+ * HT_MAX_LEAVES leaves hold the whole file.
+ *
+ *****************************************************************************/
+PRIVATE int leaf_sects(int size)
 {
-	context->count[0] = context->count[1] = 0;
-	context->state[0] = 0x67452301;
-	context->state[1] = 0xefcdab89;
-	context->state[2] = 0x98badcfe;
-	context->state[3] = 0x10325476;
+	int n = HT_LEAF_SECTS;
+	while ((u32)n * SECTOR_SIZE * HT_MAX_LEAVES < (u32)size)
+		n <<= 1;
+	return n;
 }
 
-PRIVATE void md5_update(MD5_CTX *context, u8 *input, unsigned int inputLen)
+/*****************************************************************************
+ *                                ht_find
+ *****************************************************************************/
+/**
+ * The tree kept for a file, if any.
+ *
+ *****************************************************************************/
+PRIVATE struct hash_tree * ht_find(struct inode * pin)
 {
-	unsigned int i, index, partLen;
-
-	index = (unsigned int)((context->count[0] >> 3) & 0x3F);
-
-	if ((context->count[0] += ((u32)inputLen << 3)) < ((u32)inputLen << 3))
-		context->count[1]++;
-	context->count[1] += ((u32)inputLen >> 29);
+	int i;
 
-	partLen = 64 - index;
+	if (!hash_trees) {
+		hash_trees = (struct hash_tree *)htbuf;
+		memset(hash_trees, 0, HTBUF_SIZE);
+	}
 
-	if (inputLen >= partLen) {
-		memcpy((char*)&context->buffer[index], (char*)input, partLen);
-		md5_transform(context->state, context->buffer);
+	for (i = 0; i < NR_HASH_TREES; i++) {
+		struct hash_tree * t = &hash_trees[i];
+		if (t->t_num == pin->i_num && t->t_dev == pin->i_dev)
+			return t;
+	}
+	return 0;
+}
 
-		for (i = partLen; i + 63 < inputLen; i += 64)
-			md5_transform(context->state, &input[i]);
+/*****************************************************************************
+ *                                ht_drop
+ *****************************************************************************/
+/**
+ * <Ring 1> Forget the tree of a file, e.g. because its size has changed in
+ * a way ht_dirty() can't tell. The next hash starts from scratch.
+ *
+ * @param pin  I-node of the file.
+ *****************************************************************************/
+PUBLIC void ht_drop(struct inode * pin)
+{
+	struct hash_tree * t = ht_find(pin);
+	if (t)
+		t->t_num = 0;
+}
 
-		index = 0;
-	} else {
-		i = 0;
+/*****************************************************************************
+ *                                ht_dirty
+ *****************************************************************************/
+/**
+ * <Ring 1> Some bytes of a file are being written, their leaves must be
+ * hashed again.
+ *
+ * @param pin  I-node of the file.
+ * @param pos  The 1st byte written.
+ * @param len  How many bytes.
+ *****************************************************************************/
+PUBLIC void ht_dirty(struct inode * pin, int pos, int len)
+{
+	struct hash_tree * t = ht_find(pin);
+	if (!t || len <= 0)
+		return;
+
+	/* past the end, the leaves may get longer */
+	int end = max(pos + len, t->t_size);
+	if (leaf_sects(end) != t->t_leaf_sects) {
+		t->t_num = 0;
+		return;
 	}
 
-	memcpy((char*)&context->buffer[index], (char*)&input[i], inputLen - i);
+	/* so does whatever lies between the old end and `pos' */
+	int leaf_bytes = t->t_leaf_sects * SECTOR_SIZE;
+	int k;
+	for (k = min(pos, t->t_size) / leaf_bytes;
+	     k <= (pos + len - 1) / leaf_bytes; k++)
+		HT_MARK_NODE(t, HT_MAX_LEAVES + k);
 }
 
-PRIVATE void md5_final(u8 digest[16], MD5_CTX *context)
+/*****************************************************************************
+ *                                ht_hash_leaf
+ *****************************************************************************/
+/**
+ * Hash the k-th leaf of a file into its node.
+ *
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PRIVATE int ht_hash_leaf(struct inode * pin, struct hash_tree * t, int k,
+			 u8 * key)
 {
-	u8 bits[8];
-	unsigned int index, padLen;
+	u8 * node = t->t_node[HT_MAX_LEAVES + k];
+	int leaf_bytes = t->t_leaf_sects * SECTOR_SIZE;
+	int bytes = min((int)pin->i_size - k * leaf_bytes, leaf_bytes);
+	HASH_CTX ctx;
 
-	md5_encode(bits, context->count, 8);
+	if (bytes <= 0) {
+		memset(node, 0, HT_DIGEST_LEN);
+		return 0;
+	}
 
-	index = (unsigned int)((context->count[0] >> 3) & 0x3f);
-	padLen = (index < 56) ? (56 - index) : (120 - index);
-	md5_update(context, PADDING, padLen);
+	hash_init(&ctx, &CHECKSUM_HASH, key, 4, HT_DIGEST_LEN);
+	hash_update(&ctx, &k, 4);
 
-	md5_update(context, bits, 8);
+	int lsect = k * t->t_leaf_sects;
+	while (bytes > 0) {
+		int sect_nr = bmap(pin, lsect++, 0);
+		if (!sect_nr)
+			return -1;
+		RD_SECT(pin->i_dev, sect_nr);
 
-	md5_encode(digest, context->state, 16);
+		int chunk = min(bytes, SECTOR_SIZE);
+		hash_update(&ctx, fsbuf, chunk);
+		bytes -= chunk;
+	}
 
-	memset((char*)context, 0, sizeof(*context));
+	hash_final(&ctx, node);
+	return 0;
 }
 
-PRIVATE char hex_chars[] = "0123456789abcdef";
-
-PRIVATE void bytes_to_hex(u8 *bytes, int len, char *hex_str)
+/*****************************************************************************
+ *                                ht_hash_node
+ *****************************************************************************/
+/**
+ * Hash the two children of node n into it.
+ *
+ *****************************************************************************/
+PRIVATE void ht_hash_node(struct hash_tree * t, int n, u8 * key)
 {
-	int i;
-	for (i = 0; i < len; i++) {
-		hex_str[i * 2]     = hex_chars[(bytes[i] >> 4) & 0x0F];
-		hex_str[i * 2 + 1] = hex_chars[bytes[i] & 0x0F];
-	}
-	hex_str[len * 2] = '\0';
+	HASH_CTX ctx;
+
+	hash_init(&ctx, &CHECKSUM_HASH, key, 4, HT_DIGEST_LEN);
+	hash_update(&ctx, t->t_node[2 * n], 2 * HT_DIGEST_LEN);
+	hash_final(&ctx, t->t_node[n]);
 }
 
+/*****************************************************************************
+ *                                calc_md5_for_file
+ *****************************************************************************/
+/**
+ * The root of the hash tree of a file, in hex. Only the nodes which are not
+ * up to date are hashed.
+ *
+ * @param pin  I-node of the file.
+ * @param out  Where the root goes.
+ *
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
 PRIVATE int calc_md5_for_file(struct inode *pin, char out[MD5_STR_BUF_LEN])
 {
-	u8 digest[16];
+	u8 digest[HT_DIGEST_LEN];
 	u8 key_bytes[4];
-	MD5_CTX ctx;
+	HASH_CTX ctx;
+	int n;
 
 	if (!pin || !out)
 		return -1;
@@ -276,30 +246,53 @@ PRIVATE int calc_md5_for_file(struct inode *pin, char out[MD5_STR_BUF_LEN])
 	key_bytes[2] = (u8)((s_ck_key >> 16) & 0xFF);
 	key_bytes[3] = (u8)((s_ck_key >> 24) & 0xFF);
 
-	// MD5(key||file_content||key)
-	md5_init(&ctx);
-	md5_update(&ctx, key_bytes, 4);  // 前置 key
-
-	// 按扇区循环读取文件内容
-	u32 bytes_left = pin->i_size;
-	u32 sect_nr = pin->i_start_sect;
-
-	while (bytes_left > 0) {
-		RD_SECT(pin->i_dev, sect_nr);
-
-		u32 chunk = (bytes_left < SECTOR_SIZE) ? bytes_left : SECTOR_SIZE;
-
-		md5_update(&ctx, (u8*)fsbuf, chunk);
-
-		bytes_left -= chunk;
-		sect_nr++;
+	struct hash_tree * t = ht_find(pin);
+	if (t && leaf_sects(pin->i_size) != t->t_leaf_sects)
+		t->t_num = 0;
+	if (!t || !t->t_num) {
+		/* a new tree, in a free or the least recently used slot */
+		int i;
+		t = &hash_trees[0];
+		for (i = 1; i < NR_HASH_TREES && t->t_num; i++)
+			if (!hash_trees[i].t_num ||
+			    hash_trees[i].t_used < t->t_used)
+				t = &hash_trees[i];
+
+		t->t_dev = pin->i_dev;
+		t->t_num = pin->i_num;
+		t->t_leaf_sects = leaf_sects(pin->i_size);
+		memset(t->t_dirty, 0xFF, sizeof(t->t_dirty));
 	}
+	t->t_used = ++ht_clock;
+
+	/* children come after their parents, so go backwards */
+	for (n = 2 * HT_MAX_LEAVES - 1; n > 0; n--) {
+		if (!HT_NODE_DIRTY(t, n))
+			continue;
+		if (n >= HT_MAX_LEAVES) {
+			if (ht_hash_leaf(pin, t, n - HT_MAX_LEAVES,
+					 key_bytes) != 0) {
+				t->t_num = 0;
+				return -1;
+			}
+		}
+		else {
+			ht_hash_node(t, n, key_bytes);
+		}
+		HT_CLEAR_NODE(t, n);
+		if (n > 1)
+			HT_MARK_NODE(t, n >> 1);
+	}
+	t->t_size = pin->i_size;
 
-	md5_update(&ctx, key_bytes, 4);  // 后置 key
-	md5_final(digest, &ctx);
+	hash_init(&ctx, &CHECKSUM_HASH, key_bytes, 4, HT_DIGEST_LEN);
+	hash_update(&ctx, &pin->i_size, 4);
+	hash_update(&ctx, &t->t_leaf_sects, 4);
+	hash_update(&ctx, t->t_node[1], HT_DIGEST_LEN);
+	hash_final(&ctx, digest);
 
 	// 转为 32 字符 hex 字符串
-	bytes_to_hex(digest, 16, out);
+	bytes_to_hex(digest, HT_DIGEST_LEN, out);
 
 	return 0;
 }
@@ -320,25 +313,24 @@ PUBLIC int do_stat()
 		  name_len);
 	pathname[name_len] = 0;
 
-	int inode_nr = search_file(pathname);
-	if (inode_nr == INVALID_INODE) {
-		printl("{FS} FS::do_stat():: search_file() returns invalid inode: %s\n",
-		       pathname);
-		return -1;
-	}
-
+	/* like search_file(), but the path is walked only once */
 	struct inode * dir_inode;
 	if (strip_path(filename, pathname, &dir_inode) != 0)
 		return -1;
 
+	int inode_nr = filename[0] == 0 ? dir_inode->i_num :
+		dir_lookup(dir_inode, filename);
+	if (inode_nr == INVALID_INODE) {
+		put_inode(dir_inode);
+		printl("{FS} FS::do_stat():: no such file: %s\n", pathname);
+		return -1;
+	}
+
 	struct inode * pin = get_inode(dir_inode->i_dev, inode_nr);
+	put_inode(dir_inode);
 
 	struct stat s;
-	s.st_dev  = pin->i_dev;
-	s.st_ino  = pin->i_num;
-	s.st_mode = pin->i_mode;
-	s.st_rdev = is_special(pin->i_mode) ? pin->i_start_sect : NO_DEV;
-	s.st_size = pin->i_size;
+	fill_stat(pin, &s);
 
 	put_inode(pin);
 
@@ -349,6 +341,98 @@ PUBLIC int do_stat()
 	return 0;
 }
 
+/*****************************************************************************
+ *                                do_fstat
+ *****************************************************************************/
+/**
+ * Handle the message FSTAT: stat() the file opened as FD. The i-node is
+ * already held by the fd, so no path is walked.
+ *
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_fstat()
+{
+	int fd = fs_msg.FD;
+
+	if (fd < 0 || fd >= NR_FILES || !pcaller->filp[fd])
+		return -1;
+
+	struct stat s;
+	fill_stat(pcaller->filp[fd]->fd_inode, &s);
+
+	phys_copy((void*)va2la(fs_msg.source, fs_msg.BUF),
+		  (void*)va2la(TASK_FS, &s),
+		  sizeof(struct stat));
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                do_readdir
+ *****************************************************************************/
+/**
+ * Handle the message READDIR: fill BUF with as many entries of the directory
+ * FD as there are room for in CNT bytes, each with the status of its file,
+ * so that a listing needn't stat() every name. It starts at the offset of
+ * the fd and moves it past the last entry returned. "." and ".." are
+ * returned like the others.
+ *
+ * @return How many entries are in BUF, 0 at the end of the directory, -1 if
+ *         FD isn't a directory.
+ *****************************************************************************/
+PUBLIC int do_readdir()
+{
+	int fd = fs_msg.FD;
+	int src = fs_msg.source;
+	int max = fs_msg.CNT / (int)sizeof(struct dirent);
+
+	if (fd < 0 || fd >= NR_FILES || !pcaller->filp[fd])
+		return -1;
+
+	struct file_desc * f = pcaller->filp[fd];
+	struct inode * dir = f->fd_inode;
+	if (dir->i_mode != I_DIRECTORY)
+		return -1;
+
+	struct dirent d;
+	char * dst = fs_msg.BUF;
+	int slot = f->fd_pos / DIR_ENTRY_SIZE;
+	int n;
+
+	for (n = 0; n < max; n++, slot++) {
+		int inode_nr = dir_next(dir, &slot, d.d_name);
+		if (inode_nr == INVALID_INODE)
+			break;
+		d.d_name[MAX_FILENAME_LEN] = 0;
+
+		struct inode * pin = get_inode(dir->i_dev, inode_nr);
+		fill_stat(pin, &d.d_st);
+		put_inode(pin);
+
+		phys_copy((void*)va2la(src, dst + n * sizeof(struct dirent)),
+			  (void*)va2la(TASK_FS, &d),
+			  sizeof(struct dirent));
+	}
+
+	f->fd_pos = slot * DIR_ENTRY_SIZE;
+	return n;
+}
+
+/*****************************************************************************
+ *                                fill_stat
+ *****************************************************************************/
+/**
+ * The status of a file, as stat() returns it.
+ *****************************************************************************/
+PRIVATE void fill_stat(struct inode * pin, struct stat * s)
+{
+	s->st_dev  = pin->i_dev;
+	s->st_ino  = pin->i_num;
+	s->st_mode = pin->i_mode;
+	s->st_rdev = is_special(pin->i_mode) ? pin->i_start_sect : NO_DEV;
+	s->st_size = pin->i_size;
+}
+
 // PUBLIC int do_calc_checksum()
 // {
 // 	char pathname[MAX_PATH];
@@ -408,6 +492,20 @@ PUBLIC int do_verify_checksum()
 		return -1;
 
 	struct inode * pin = get_inode(dir_inode->i_dev, inode_nr);
+	put_inode(dir_inode);
+
+	/* its first exec since boot, trust what was there at boot */
+	if (ck_take(pin->i_dev, pin->i_num)) {
+		int ret = ck_refresh(pin);
+		put_inode(pin);
+		return ret;
+	}
+
+	/* not changed since it was verified last time */
+	if (pin->i_ck_gen == pin->i_gen) {
+		put_inode(pin);
+		return 0;
+	}
 
 	char md5_str[MD5_STR_BUF_LEN];
 	if (calc_md5_for_file(pin, md5_str) != 0)
@@ -424,131 +522,232 @@ PUBLIC int do_verify_checksum()
 		}
 	}
 
+	pin->i_ck_gen = pin->i_gen;
 	put_inode(pin);
 	return 0;
 }
 
-PUBLIC int do_refresh_checksums()
-{
-	int src = fs_msg.source;
-
-	// 仅允许 INIT 进程调用，防止普通用户绕过校验
-	if (src != INIT)
-		return -1;
+/*****************************************************************************
+ *                                refreshing checksums
+ *****************************************************************************
+ * The key is new at every boot, so the checksums of the whitelisted
+ * commands have to be computed again before they can be verified. Hashing
+ * all of them used to hold Init, and so the shells, for a long while.
+ * Now REFRESH_CHECKSUMS from Init only puts them in ck_pending, and each
+ * of them is refreshed by whichever comes first:
+ *
+ *   - the first VERIFY_CHECKSUM of the command, i.e. its first exec;
+ *   - TASK FLUSH, which asks for one at a time in the background.
+ *
+ * What is trusted is still the data as it was at boot: a command changed
+ * before it is refreshed drops out of ck_pending (ck_forget()), and it
+ * fails verification just like one changed after an eager refresh would.
+ *****************************************************************************/
 
-	int dev = root_inode->i_dev;
-	int dir_blk0 = root_inode->i_start_sect;
-	int nr_dir_blks = (root_inode->i_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
-	int nr_entries = root_inode->i_size / DIR_ENTRY_SIZE;
+PRIVATE struct {
+	int	dev;
+	int	num;		/**< 0: unused */
+} ck_pending[NR_CK_PENDING];
 
-	int seen = 0;
-	int refreshed = 0;
-	int i, j;
-	char dir_sect_buf[SECTOR_SIZE];
+/*****************************************************************************
+ *                                ck_take
+ *****************************************************************************/
+/**
+ * Take a file out of ck_pending.
+ *
+ * @return Nonzero if it was there.
+ *****************************************************************************/
+PRIVATE int ck_take(int dev, int num)
+{
+	int i;
+	for (i = 0; i < NR_CK_PENDING; i++) {
+		if (ck_pending[i].num == num && ck_pending[i].dev == dev) {
+			ck_pending[i].num = 0;
+			return 1;
+		}
+	}
+	return 0;
+}
 
-	for (i = 0; i < nr_dir_blks; i++) {
-		RD_SECT(dev, dir_blk0 + i);
+/*****************************************************************************
+ *                                ck_forget
+ *****************************************************************************/
+/**
+ * <Ring 1> The data of a file is about to change, if its checksum is still
+ * to be refreshed it must not be.
+ *
+ * @param pin  I-node of the file.
+ *****************************************************************************/
+PUBLIC void ck_forget(struct inode * pin)
+{
+	ck_take(pin->i_dev, pin->i_num);
+}
 
-		// fix bug：calc_md5_for_file() 内部会调用 RD_SECT 并覆写 fsbuf。
-		// 如果直接用 fsbuf 遍历目录项，pde 会在第一次算 hash 后失效。
-		// 所以这里先把目录扇区拷贝出来，再在本地缓冲区上遍历。
+/*****************************************************************************
+ *                                ck_refresh
+ *****************************************************************************/
+/**
+ * Compute the checksum of a file and store it.
+ *
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PRIVATE int ck_refresh(struct inode * pin)
+{
+	char md5_str[MD5_STR_BUF_LEN];
 
-		memcpy(dir_sect_buf, (char*)fsbuf, SECTOR_SIZE);
-		struct dir_entry * pde = (struct dir_entry *)dir_sect_buf;
+	if (calc_md5_for_file(pin, md5_str) != 0)
+		return -1;
 
-		for (j = 0; j < SECTOR_SIZE / DIR_ENTRY_SIZE && seen < nr_entries; j++, pde++, seen++) {
-			if (pde->inode_nr == 0)
-				continue;
+	memcpy(pin->md5_checksum, md5_str, MD5_HASH_LEN);
+	pin->i_ck_gen = pin->i_gen;
+	sync_inode(pin);
+	return 0;
+}
 
-			char name[MAX_FILENAME_LEN + 1];
-			memcpy(name, pde->name, MAX_FILENAME_LEN);
-			name[MAX_FILENAME_LEN] = 0;
+/*****************************************************************************
+ *                                do_refresh_checksums
+ *****************************************************************************/
+/**
+ * Handle the message REFRESH_CHECKSUMS.
+ *
+ * From INIT: the whitelisted commands in the root directory are to be
+ * refreshed. From TASK FLUSH: refresh one of them.
+ *
+ * @return From INIT, how many commands are to be refreshed. From TASK
+ *         FLUSH, how many are left. Otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_refresh_checksums()
+{
+	int src = fs_msg.source;
+	int i;
+	int n = 0;
 
-			// 白名单：仅对已实现的系统命令刷新校验和
-			if (!is_syscmd_whitelisted(name))
+	// 仅允许 INIT 进程调用，防止普通用户绕过校验
+	if (src == INIT) {
+		int dev = root_inode->i_dev;
+		memset(ck_pending, 0, sizeof(ck_pending));
+
+		for (i = 0; i < g_syscmd_whitelist_len && n < NR_CK_PENDING;
+		     i++) {
+			int inode_nr = dir_lookup(root_inode,
+						  g_syscmd_whitelist[i]);
+			if (inode_nr == INVALID_INODE)
 				continue;
 
-			struct inode * pin = get_inode(dev, pde->inode_nr);
-			int imode = pin->i_mode & I_TYPE_MASK;
-
+			struct inode * pin = get_inode(dev, inode_nr);
 			// 只对普通文件做校验
-			if (imode == I_REGULAR) {
-				char md5_str[MD5_STR_BUF_LEN];
-				if (calc_md5_for_file(pin, md5_str) == 0) {
-					memcpy(pin->md5_checksum, md5_str, MD5_HASH_LEN);
-					sync_inode(pin);
-					refreshed++;
-				}
+			if (pin->i_mode == I_REGULAR) {
+				ck_pending[n].dev = dev;
+				ck_pending[n].num = inode_nr;
+				n++;
 			}
 			put_inode(pin);
 		}
+		return n;
+	}
+
+	if (src != TASK_FLUSH)
+		return -1;
+
+	for (i = 0; i < NR_CK_PENDING && !ck_pending[i].num; i++)
+		;
+	if (i < NR_CK_PENDING) {
+		struct inode * pin = get_inode(ck_pending[i].dev,
+					       ck_pending[i].num);
+		ck_pending[i].num = 0;
+		ck_refresh(pin);
+		put_inode(pin);
 	}
 
-	return refreshed;
+	for (; i < NR_CK_PENDING; i++)
+		if (ck_pending[i].num)
+			n++;
+	return n;
 }
 
 /*****************************************************************************
  *                                search_file
  *****************************************************************************/
+/**
+ * Search the file and return the inode_nr.
+ *
+ * @param[in] path The full path of the file to search.
+ * @return         The i-node nr of the file if successful, otherwise zero.
+ * 
+ * @see open()
+ * @see do_open()
+ *****************************************************************************/
 PUBLIC int search_file(char * path)
 {
-	int i, j;
-
 	char filename[MAX_PATH];
-	memset(filename, 0, MAX_FILENAME_LEN);
 	struct inode * dir_inode;
 	if (strip_path(filename, path, &dir_inode) != 0)
 		return 0;
 
-	if (filename[0] == 0)
-		return dir_inode->i_num;
-
-	int dir_blk0_nr = dir_inode->i_start_sect;
-	int nr_dir_blks = (dir_inode->i_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
-	int nr_dir_entries = dir_inode->i_size / DIR_ENTRY_SIZE;
-
-	int m = 0;
-	struct dir_entry * pde;
-	for (i = 0; i < nr_dir_blks; i++) {
-		RD_SECT(dir_inode->i_dev, dir_blk0_nr + i);
-		pde = (struct dir_entry *)fsbuf;
-		for (j = 0; j < SECTOR_SIZE / DIR_ENTRY_SIZE; j++,pde++) {
-			if (memcmp(filename, pde->name, MAX_FILENAME_LEN) == 0)
-				return pde->inode_nr;
-			if (++m > nr_dir_entries)
-				break;
-		}
-		if (m > nr_dir_entries)
-			break;
-	}
+	int inode_nr = filename[0] == 0 ? dir_inode->i_num :
+		dir_lookup(dir_inode, filename);
 
-	return 0;
+	put_inode(dir_inode);
+	return inode_nr;
 }
 
 /*****************************************************************************
  *                                strip_path
  *****************************************************************************/
+/**
+ * Walk a path down to the directory holding its last component.
+ *
+ * E.g., if pathname is "/usr/bin/ls", the directory "/usr/bin" is looked
+ * up and "ls" is returned in filename. A trailing '/' leaves filename empty
+ * and the directory is the whole path. A component longer than
+ * MAX_FILENAME_LEN is cut short, as it is in dir_entry.
+ *
+ * @param[out] filename The string for the result.
+ * @param[in]  pathname The full pathname.
+ * @param[out] ppinode  The ptr of the dir's inode will be stored here. The
+ *                      caller must put_inode() it.
+ * 
+ * @return Zero if success, otherwise the pathname is not valid.
+ *****************************************************************************/
 PUBLIC int strip_path(char * filename, const char * pathname, struct inode** ppinode)
 {
 	const char * s = pathname;
-	char * t = filename;
 
 	if (s == 0)
 		return -1;
 
-	if (*s == '/')
-		s++;
+	struct inode * dir = get_inode(root_inode->i_dev, ROOT_INODE);
 
-	while (*s) {
-		if (*s == '/')
-			return -1;
-		*t++ = *s++;
-		if (t - filename >= MAX_FILENAME_LEN)
+	while (1) {
+		char * t = filename;
+
+		while (*s == '/')
+			s++;
+		for (; *s && *s != '/'; s++)
+			if (t - filename < MAX_FILENAME_LEN)
+				*t++ = *s;
+		*t = 0;
+
+		while (*s == '/')
+			s++;
+		if (*s == 0)	/* filename is the last component */
 			break;
+
+		int inode_nr = dir_lookup(dir, filename);
+		if (inode_nr == INVALID_INODE) {
+			put_inode(dir);
+			return -1;
+		}
+
+		struct inode * pin = get_inode(dir->i_dev, inode_nr);
+		put_inode(dir);
+		if ((pin->i_mode & I_TYPE_MASK) != I_DIRECTORY) {
+			put_inode(pin);
+			return -1;
+		}
+		dir = pin;
 	}
-	*t = 0;
 
-	*ppinode = root_inode;
+	*ppinode = dir;
 	return 0;
 }
-
@@ -0,0 +1,144 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mmap.c
+ * @brief  The FS side of mmap().
+ *
+ * MM owns the frames a file is mapped into (see mm/shm.c). FS only moves
+ * the data between them and the buffer cache: FMAP_OPEN fills the frames
+ * when the file is mapped, FMAP_WRITE brings back the pages MM has found
+ * dirty, and FMAP_CLOSE lets the file go. In between FS holds the i-node,
+ * which is what MM gets as the handle of the mapping.
+ *
+ * Only TASK MM may send these.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+PRIVATE struct inode *	fmap_inode(int handle);
+
+/*****************************************************************************
+ *                                do_fmap_open
+ *****************************************************************************/
+/**
+ * Handle the message FMAP_OPEN: the file FD of proc PROC_NR is being mapped,
+ * copy CNT bytes of it from POSITION into the frames at BUF (in MM). What is
+ * past the end of the file is left alone, MM has zeroed it.
+ * 
+ * @return The handle of the mapping, or -1 if the fd can't be mapped.
+ *****************************************************************************/
+PUBLIC int do_fmap_open()
+{
+	if (fs_msg.source != TASK_MM)
+		return -1;
+
+	struct proc * p = &proc_table[proc_table[fs_msg.PROC_NR].p_tgid];
+	int fd = fs_msg.FD;
+	int pos = (int)fs_msg.POSITION;
+	int len = fs_msg.CNT;
+
+	if (fd < 0 || fd >= NR_FILES || !p->filp[fd] ||
+	    !(p->filp[fd]->fd_mode & O_RDWR))
+		return -1;
+
+	struct inode * pin = p->filp[fd]->fd_inode;
+	if (!pin || pin->i_mode != I_REGULAR || pos < 0 || len < 0)
+		return -1;
+
+	/* a parked WRITE may not have reached the cache yet */
+	if (parked_on(pin)) {
+		defer_msg();
+		return 0;
+	}
+
+	/* held until FMAP_CLOSE */
+	pin->i_cnt++;
+
+	int n = min(len, max((int)pin->i_size - pos, 0));
+	cache_rw(pin, pos, TASK_MM, fs_msg.BUF, n, 0);
+
+	return pin - inode_table;
+}
+
+/*****************************************************************************
+ *                                do_fmap_write
+ *****************************************************************************/
+/**
+ * Handle the message FMAP_WRITE: CNT bytes at BUF (in MM) go to POSITION of
+ * the file mapped as FD. As with mmap() elsewhere, the file doesn't grow,
+ * whatever is past its end is dropped.
+ * 
+ * @return How many bytes have been written, -1 if the handle is invalid.
+ *****************************************************************************/
+PUBLIC int do_fmap_write()
+{
+	struct inode * pin = fmap_inode(fs_msg.FD);
+	int pos = (int)fs_msg.POSITION;
+
+	if (!pin || pos < 0)
+		return -1;
+
+	if (parked_on(pin)) {
+		defer_msg();
+		return 0;
+	}
+
+	int n = min(fs_msg.CNT, max((int)pin->i_size - pos, 0));
+	if (n <= 0)
+		return 0;
+
+	/* a verified checksum no longer holds */
+	pin->i_gen++;
+	ht_dirty(pin, pos, n);
+	ck_forget(pin);
+
+	cache_rw(pin, pos, TASK_MM, fs_msg.BUF, n, 1);
+	return n;
+}
+
+/*****************************************************************************
+ *                                do_fmap_close
+ *****************************************************************************/
+/**
+ * Handle the message FMAP_CLOSE: the mapping FD is gone.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_fmap_close()
+{
+	struct inode * pin = fmap_inode(fs_msg.FD);
+	if (!pin)
+		return -1;
+
+	put_inode(pin);
+	return 0;
+}
+
+/*****************************************************************************
+ *                                fmap_inode
+ *****************************************************************************/
+/**
+ * The i-node behind the handle of a mapping.
+ * 
+ *****************************************************************************/
+PRIVATE struct inode * fmap_inode(int handle)
+{
+	if (fs_msg.source != TASK_MM || handle < 0 || handle >= NR_INODE)
+		return 0;
+
+	struct inode * pin = &inode_table[handle];
+	if (pin->i_cnt == 0 || pin->i_mode != I_REGULAR)
+		return 0;
+	return pin;
+}
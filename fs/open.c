@@ -6,6 +6,7 @@
  *   - do_close()
  *   - do_lseek()
  *   - create_file()
+ *   - do_mkdir()
  * @author Forrest Yu
  * @date   2007
  *****************************************************************************
@@ -24,18 +25,8 @@
 #include "keyboard.h"
 #include "proto.h"
 
-#define MIN_FILE_SECTS 1
-
-PRIVATE struct inode * create_file(char * path, int flags);
-PRIVATE int alloc_imap_bit(int dev);
-PRIVATE void free_imap_bit(int dev, int inode_nr);
-PRIVATE int alloc_smap_bit(int dev, int *nr_sects_to_alloc);
-PRIVATE struct inode * new_inode(int dev, int inode_nr, int start_sect, int nr_sects);
-PRIVATE void new_dir_entry(struct inode * dir_inode, int inode_nr, char * filename);
-PRIVATE int find_free_run(int dev, int smap_blk0_nr, int nr_smap_sects,
-		int nr_sects_to_alloc);
-PRIVATE void mark_smap_bits(int dev, int smap_blk0_nr, int start_bit,
-		int nr_sects_to_alloc);
+PRIVATE struct inode * create_file(char * path, int mode);
+PRIVATE struct inode * new_inode(int dev, int inode_nr, int mode);
 
 /*****************************************************************************
  *                                do_open
@@ -86,7 +77,7 @@ PUBLIC int do_open()
 
 	if (inode_nr == INVALID_INODE) { /* file not exists */
 		if (flags & O_CREAT) {
-			pin = create_file(pathname, flags);
+			pin = create_file(pathname, I_REGULAR);
 		}
 		else {
 			printl("{FS} file not exists: %s\n", pathname);
@@ -108,6 +99,20 @@ PUBLIC int do_open()
 		if (strip_path(filename, pathname, &dir_inode) != 0)
 			return -1;
 		pin = get_inode(dir_inode->i_dev, inode_nr);
+		put_inode(dir_inode);
+
+		if ((flags & O_TRUNC) && pin->i_mode != I_REGULAR) {
+			printl("{FS} cannot truncate: %s\n", pathname);
+			put_inode(pin);
+			return -1;
+		}
+
+		/* a parked WRITE would bring the old size back */
+		if ((flags & O_TRUNC) && parked_on(pin)) {
+			put_inode(pin);
+			defer_msg();
+			return 0;
+		}
 	}
 	else { /* file exists, no O_RDWR flag */
 		printl("{FS} file exists: %s\n", pathname);
@@ -116,8 +121,11 @@ PUBLIC int do_open()
 
 	if (flags & O_TRUNC) {
 		assert(pin);
+		pin->i_gen++;
+		ht_drop(pin);
+		ck_forget(pin);
 		pin->i_size = 0;
-		sync_inode(pin);
+		shrink_file(pin, 0);	/* syncs the i-node */
 	}
 
 	if (pin) {
@@ -130,6 +138,8 @@ PUBLIC int do_open()
 		f_desc_table[i].fd_mode = flags;
 		f_desc_table[i].fd_cnt = 1;
 		f_desc_table[i].fd_pos = 0;
+		f_desc_table[i].fd_ra_pos = 0;
+		f_desc_table[i].fd_ra_win = 0;
 
 		int imode = pin->i_mode & I_TYPE_MASK;
 
@@ -144,10 +154,7 @@ PUBLIC int do_open()
 				  dd_map[MAJOR(dev)].driver_nr,
 				  &driver_msg);
 		}
-		else if (imode == I_DIRECTORY) {
-			assert(pin->i_num == ROOT_INODE);
-		}
-		else {
+		else if (imode != I_DIRECTORY) {
 			assert(pin->i_mode == I_REGULAR);
 		}
 	}
@@ -162,40 +169,87 @@ PUBLIC int do_open()
  *                                create_file
  *****************************************************************************/
 /**
- * Create a file and return it's inode ptr.
+ * Create a file and return it's inode ptr. A new directory gets its "."
+ * and ".." entries.
  *
  * @param[in] path   The full path of the new file
- * @param[in] flags  Attribiutes of the new file
+ * @param[in] mode   I_REGULAR or I_DIRECTORY
  *
  * @return           Ptr to i-node of the new file if successful, otherwise 0.
  * 
  * @see open()
  * @see do_open()
+ * @see do_mkdir()
  *****************************************************************************/
-PRIVATE struct inode * create_file(char * path, int flags)
+PRIVATE struct inode * create_file(char * path, int mode)
 {
 	char filename[MAX_PATH];
 	struct inode * dir_inode;
 	if (strip_path(filename, path, &dir_inode) != 0)
 		return 0;
 
-	int inode_nr = alloc_imap_bit(dir_inode->i_dev);
-	int nr_sects = NR_DEFAULT_FILE_SECTS;
-	int free_sect_nr = alloc_smap_bit(dir_inode->i_dev, &nr_sects);
-	if (!free_sect_nr) {
-		printl("{FS} insufficient space for %s\n", path);
-		/* roll back inode allocation */
-		free_imap_bit(dir_inode->i_dev, inode_nr);
+	if (filename[0] == 0) {
+		put_inode(dir_inode);
 		return 0;
 	}
-	struct inode *newino = new_inode(dir_inode->i_dev, inode_nr,
-					 free_sect_nr, nr_sects);
 
-	new_dir_entry(dir_inode, newino->i_num, filename);
+	int inode_nr = alloc_imap_bit(dir_inode->i_dev);
+	/* sectors are allocated as the file is written */
+	struct inode *newino = new_inode(dir_inode->i_dev, inode_nr, mode);
+
+	if ((mode == I_DIRECTORY &&
+	     (dir_add(newino, ".", newino->i_num) != 0 ||
+	      dir_add(newino, "..", dir_inode->i_num) != 0)) ||
+	    dir_add(dir_inode, filename, newino->i_num) != 0) {
+		printl("{FS} no room for %s\n", path);
+		dir_free_index(newino);
+		shrink_file(newino, 0);
+		newino->i_mode = 0;
+		newino->i_size = 0;
+		sync_inode(newino);
+		put_inode(newino);
+		free_imap_bit(dir_inode->i_dev, inode_nr);
+		newino = 0;
+	}
 
+	put_inode(dir_inode);
 	return newino;
 }
 
+/*****************************************************************************
+ *                                do_mkdir
+ *****************************************************************************/
+/**
+ * Handle the message MKDIR.
+ * 
+ * @return Zero if success, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_mkdir()
+{
+	char pathname[MAX_PATH];
+
+	/* get parameters from the message */
+	int name_len = fs_msg.NAME_LEN;	/* length of filename */
+	int src = fs_msg.source;	/* caller proc nr. */
+	assert(name_len < MAX_PATH);
+	phys_copy((void*)va2la(TASK_FS, pathname),
+		  (void*)va2la(src, fs_msg.PATHNAME),
+		  name_len);
+	pathname[name_len] = 0;
+
+	if (search_file(pathname) != INVALID_INODE) {
+		printl("{FS} file exists: %s\n", pathname);
+		return -1;
+	}
+
+	struct inode * pin = create_file(pathname, I_DIRECTORY);
+	if (!pin)
+		return -1;
+
+	put_inode(pin);
+	return 0;
+}
+
 /*****************************************************************************
  *                                do_close
  *****************************************************************************/
@@ -284,114 +338,35 @@ PUBLIC int do_truncate()
 	if (length < 0)
 		return -1;
 
-	max_len = pin->i_nr_sects * SECTOR_SIZE;
-	if (length > max_len)
-		length = max_len;
-
-	pin->i_size = length;
-	if (pfd->fd_pos > length)
-		pfd->fd_pos = length;
-
-	sync_inode(pin);
-	return 0;
-}
-
-/*****************************************************************************
- *                                alloc_imap_bit
- *****************************************************************************/
-/**
- * Allocate a bit in inode-map.
- * 
- * @param dev  In which device the inode-map is located.
- * 
- * @return  I-node nr.
- *****************************************************************************/
-PRIVATE int alloc_imap_bit(int dev)
-{
-	int inode_nr = 0;
-	int i, j, k;
-
-	int imap_blk0_nr = 1 + 1; /* 1 boot sector & 1 super block */
-	struct super_block * sb = get_super_block(dev);
-
-	for (i = 0; i < sb->nr_imap_sects; i++) {
-		RD_SECT(dev, imap_blk0_nr + i);
-
-		for (j = 0; j < SECTOR_SIZE; j++) {
-			/* skip `11111111' bytes */
-			if (fsbuf[j] == 0xFF)
-				continue;
-			/* skip `1' bits */
-			for (k = 0; ((fsbuf[j] >> k) & 1) != 0; k++) {}
-			/* i: sector index; j: byte index; k: bit index */
-			inode_nr = (i * SECTOR_SIZE + j) * 8 + k;
-			fsbuf[j] |= (1 << k);
-			/* write the bit to imap */
-			WR_SECT(dev, imap_blk0_nr + i);
-			break;
-		}
+	if (pin->i_mode != I_REGULAR)
+		return -1;
 
-		return inode_nr;
+	/* a parked READ/WRITE may be using the sectors */
+	if (parked_on(pin)) {
+		defer_msg();
+		return 0;
 	}
 
-	/* no free bit in imap */
-	panic("inode-map is probably full.\n");
-
-	return 0;
-}
+	pin->i_gen++;
+	ht_drop(pin);
+	ck_forget(pin);
 
-PRIVATE void free_imap_bit(int dev, int inode_nr)
-{
-	int imap_blk0_nr = 1 + 1;
-	struct super_block * sb = get_super_block(dev);
-	int byte_idx = inode_nr / 8;
-	int bit_idx = inode_nr % 8;
-	int sect = imap_blk0_nr + byte_idx / SECTOR_SIZE;
-
-	if (byte_idx / SECTOR_SIZE >= sb->nr_imap_sects)
-		panic("free_imap_bit: invalid inode\n");
-
-	RD_SECT(dev, sect);
-	assert(fsbuf[byte_idx % SECTOR_SIZE] & (1 << bit_idx));
-	fsbuf[byte_idx % SECTOR_SIZE] &= ~(1 << bit_idx);
-	WR_SECT(dev, sect);
-}
-
-/*****************************************************************************
- *                                alloc_smap_bit
- *****************************************************************************/
-/**
- * Allocate a bit in sector-map.
- * 
- * @param dev  In which device the sector-map is located.
- * @param nr_sects_to_alloc  How many sectors are allocated.
- * 
- * @return  The 1st sector nr allocated.
- *****************************************************************************/
-PRIVATE int alloc_smap_bit(int dev, int *nr_sects_to_alloc)
-{
-	struct super_block * sb = get_super_block(dev);
-	int smap_blk0_nr = 1 + 1 + sb->nr_imap_sects;
-	int attempt = *nr_sects_to_alloc;
-	int desired = attempt;
-
-	if (attempt < MIN_FILE_SECTS)
-		attempt = MIN_FILE_SECTS;
-
-	while (attempt >= MIN_FILE_SECTS) {
-		int run_start_bit = find_free_run(dev, smap_blk0_nr,
-					      sb->nr_smap_sects, attempt);
-		if (run_start_bit > 0) {
-			mark_smap_bits(dev, smap_blk0_nr, run_start_bit, attempt);
-			*nr_sects_to_alloc = attempt;
-			if (attempt != desired)
-				printl("{FS} alloc_smap_bit: fallback to %d sectors\n",
-				       attempt);
-			return (run_start_bit - 1) + sb->n_1st_sect;
-		}
-		attempt >>= 1;
+	/* allocate or free sectors to fit the new length */
+	int nr_sects = (length + SECTOR_SIZE - 1) >> SECTOR_SIZE_SHIFT;
+	if (nr_sects > file_sects(pin)) {
+		max_len = grow_file(pin, nr_sects) * SECTOR_SIZE;
+		if (length > max_len)
+			length = max_len;
 	}
+	else {
+		shrink_file(pin, nr_sects);
+	}
+
+	pin->i_size = length;
+	if (pfd->fd_pos > length)
+		pfd->fd_pos = length;
 
+	sync_inode(pin);
 	return 0;
 }
 
@@ -399,22 +374,28 @@ PRIVATE int alloc_smap_bit(int dev, int *nr_sects_to_alloc)
  *                                new_inode
  *****************************************************************************/
 /**
- * Generate a new i-node and write it to disk.
+ * Generate a new i-node and write it to disk. It has no sectors yet.
  * 
  * @param dev  Home device of the i-node.
  * @param inode_nr  I-node nr.
- * @param start_sect  Start sector of the file pointed by the new i-node.
+ * @param mode  I_REGULAR or I_DIRECTORY.
  * 
  * @return  Ptr of the new i-node.
  *****************************************************************************/
-PRIVATE struct inode * new_inode(int dev, int inode_nr, int start_sect, int nr_sects)
+PRIVATE struct inode * new_inode(int dev, int inode_nr, int mode)
 {
 	struct inode * new_inode = get_inode(dev, inode_nr);
 
-	new_inode->i_mode = I_REGULAR;
+	new_inode->i_mode = mode;
 	new_inode->i_size = 0;
-	new_inode->i_start_sect = start_sect;
-	new_inode->i_nr_sects = nr_sects;
+	new_inode->i_start_sect = 0;
+	new_inode->i_nr_sects = 0;
+	new_inode->i_ext_start = 0;
+	new_inode->i_ext_nr = 0;
+	new_inode->i_ext_blk = 0;
+	new_inode->i_dir_idx = 0;
+	new_inode->i_ck_gen = 0;
+	ht_drop(new_inode);
 
 	new_inode->i_dev = dev;
 	new_inode->i_cnt = 1;
@@ -425,125 +406,3 @@ PRIVATE struct inode * new_inode(int dev, int inode_nr, int start_sect, int nr_s
 
 	return new_inode;
 }
-
-PRIVATE int find_free_run(int dev, int smap_blk0_nr, int nr_smap_sects,
-		int nr_sects_to_alloc)
-{
-	int run_start_bit = 0;
-	int run_len = 0;
-	int i;
-	int j;
-	int k;
-
-	for (i = 0; i < nr_smap_sects; i++) {
-		RD_SECT(dev, smap_blk0_nr + i);
-		for (j = 0; j < SECTOR_SIZE; j++) {
-			u8 byte = fsbuf[j];
-			if (byte == 0xFF) {
-				run_len = 0;
-				run_start_bit = 0;
-				continue;
-			}
-			for (k = 0; k < 8; k++) {
-				if ((byte >> k) & 1) {
-					run_len = 0;
-					run_start_bit = 0;
-					continue;
-				}
-				if (run_len == 0) {
-					int absolute_bit = (i * SECTOR_SIZE + j) * 8 + k;
-					run_start_bit = absolute_bit + 1;
-				}
-				run_len++;
-				if (run_len == nr_sects_to_alloc)
-					return run_start_bit;
-			}
-		}
-	}
-
-	return 0;
-}
-
-PRIVATE void mark_smap_bits(int dev, int smap_blk0_nr, int start_bit,
-		int nr_sects_to_alloc)
-{
-	int bits_to_mark = nr_sects_to_alloc;
-	int current_bit = start_bit - 1;
-	while (bits_to_mark > 0) {
-		int sect_offset = current_bit / (SECTOR_SIZE * 8);
-		int bit_in_sect = current_bit % (SECTOR_SIZE * 8);
-		int byte_idx = bit_in_sect / 8;
-		int bit_idx = bit_in_sect % 8;
-
-		RD_SECT(dev, smap_blk0_nr + sect_offset);
-		for (; byte_idx < SECTOR_SIZE && bits_to_mark > 0; byte_idx++) {
-			while (bit_idx < 8 && bits_to_mark > 0) {
-				assert(((fsbuf[byte_idx] >> bit_idx) & 1) == 0);
-				fsbuf[byte_idx] |= (1 << bit_idx);
-				current_bit++;
-				bits_to_mark--;
-				bit_idx++;
-			}
-			bit_idx = 0;
-		}
-		WR_SECT(dev, smap_blk0_nr + sect_offset);
-	}
-}
-
-/*****************************************************************************
- *                                new_dir_entry
- *****************************************************************************/
-/**
- * Write a new entry into the directory.
- * 
- * @param dir_inode  I-node of the directory.
- * @param inode_nr   I-node nr of the new file.
- * @param filename   Filename of the new file.
- *****************************************************************************/
-PRIVATE void new_dir_entry(struct inode *dir_inode,int inode_nr,char *filename)
-{
-	/* write the dir_entry */
-	int dir_blk0_nr = dir_inode->i_start_sect;
-	int nr_dir_blks = (dir_inode->i_size + SECTOR_SIZE) / SECTOR_SIZE;
-	int nr_dir_entries =
-		dir_inode->i_size / DIR_ENTRY_SIZE; /**
-						     * including unused slots
-						     * (the file has been
-						     * deleted but the slot
-						     * is still there)
-						     */
-	int m = 0;
-	struct dir_entry * pde;
-	struct dir_entry * new_de = 0;
-
-	int i, j;
-	for (i = 0; i < nr_dir_blks; i++) {
-		RD_SECT(dir_inode->i_dev, dir_blk0_nr + i);
-
-		pde = (struct dir_entry *)fsbuf;
-		for (j = 0; j < SECTOR_SIZE / DIR_ENTRY_SIZE; j++,pde++) {
-			if (++m > nr_dir_entries)
-				break;
-
-			if (pde->inode_nr == 0) { /* it's a free slot */
-				new_de = pde;
-				break;
-			}
-		}
-		if (m > nr_dir_entries ||/* all entries have been iterated or */
-		    new_de)              /* free slot is found */
-			break;
-	}
-	if (!new_de) { /* reached the end of the dir */
-		new_de = pde;
-		dir_inode->i_size += DIR_ENTRY_SIZE;
-	}
-	new_de->inode_nr = inode_nr;
-	strcpy(new_de->name, filename);
-
-	/* write dir block -- ROOT dir block */
-	WR_SECT(dir_inode->i_dev, dir_blk0_nr + i);
-
-	/* update dir inode */
-	sync_inode(dir_inode);
-}
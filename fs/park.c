@@ -0,0 +1,332 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   park.c
+ * @brief  Requests parked while the disk is busy.
+ *
+ * TASK FS is single-threaded. It used to wait in rw_sector() for every
+ * transfer, so an OPEN or a STAT which could be served from the caches had
+ * to wait for somebody else's READ of a megabyte. Now the data of a
+ * READ/WRITE goes through iobuf, and the request is parked (see struct
+ * fs_req) while the driver works on it:
+ *
+ *   - start_io() only sends the transfer to the driver, and FS goes back to
+ *     its RECEIVE;
+ *   - io_reply() recognizes the reply of the driver among the messages,
+ *     and run_parked() lets do_rdwt() go on with the request;
+ *   - a READ/WRITE which needs iobuf while it is busy waits in a FIFO;
+ *   - a request which can't be served while some parked one is using the
+ *     same file is deferred, i.e. its message is kept and handled again
+ *     when a parked request has finished.
+ *
+ * rw_sector() still waits for its transfer, which is fine for the few
+ * sectors of metadata that miss the cache. If the transfer of a parked
+ * request is on the way, wait_io() takes its reply first.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/* states of a deferred message */
+#define	DM_NONE		0
+#define	DM_WAIT		1	/* until a parked request finishes */
+#define	DM_RETRY	2	/* to be handled again */
+
+PRIVATE struct fs_req	reqs[NR_TASKS + NR_PROCS];	/**< By caller */
+
+PRIVATE struct fs_req *	io_owner;	/**< Who has iobuf */
+PRIVATE int		io_driver;	/**< Where its transfer went */
+PRIVATE struct fs_req *	io_queue;	/**< Waiting for iobuf, FIFO */
+
+PRIVATE MESSAGE		dmsg[NR_TASKS + NR_PROCS];	/**< By caller */
+PRIVATE int		dstate[NR_TASKS + NR_PROCS];
+PRIVATE int		dgroup[NR_TASKS + NR_PROCS];	/**< Caller's p_tgid */
+
+/*****************************************************************************
+ *                                get_req
+ *****************************************************************************/
+/**
+ * <Ring 1> The fs_req slot of a caller. A proc has at most one request in
+ * FS, so every proc has its own.
+ *
+ * @param src  Caller proc nr.
+ *
+ * @return  The slot, which must be free.
+ *****************************************************************************/
+PUBLIC struct fs_req * get_req(int src)
+{
+	struct fs_req * r = &reqs[src];
+	assert(r->r_state == RQ_FREE);
+	memset(r, 0, sizeof(struct fs_req));
+	return r;
+}
+
+/*****************************************************************************
+ *                                parked_on
+ *****************************************************************************/
+/**
+ * <Ring 1> Whether some READ/WRITE of a file is not finished yet.
+ *
+ * @param pin  I-node of the file.
+ *
+ * @return  Nonzero if so.
+ *****************************************************************************/
+PUBLIC int parked_on(struct inode * pin)
+{
+	int i;
+	for (i = 0; i < NR_TASKS + NR_PROCS; i++)
+		if (reqs[i].r_state != RQ_FREE && reqs[i].r_pin == pin)
+			return 1;
+	return 0;
+}
+
+/*****************************************************************************
+ *                                get_iobuf
+ *****************************************************************************/
+/**
+ * <Ring 1> Take iobuf for a request, or queue the request if iobuf is busy.
+ *
+ * @param r  The request.
+ *
+ * @return  Nonzero if iobuf is r's now. Otherwise r must be parked, and
+ *          run_parked() resumes it when iobuf is free.
+ *****************************************************************************/
+PUBLIC int get_iobuf(struct fs_req * r)
+{
+	if (!io_owner) {
+		io_owner = r;
+		return 1;
+	}
+
+	r->r_state = RQ_WAIT_IO;
+	r->r_next = 0;
+	if (!io_queue) {
+		io_queue = r;
+	}
+	else {
+		struct fs_req * q = io_queue;
+		while (q->r_next)
+			q = q->r_next;
+		q->r_next = r;
+	}
+	return 0;
+}
+
+/*****************************************************************************
+ *                                put_iobuf
+ *****************************************************************************/
+/**
+ * <Ring 1> Give iobuf back, after the data in it has been used.
+ *
+ * @param r  Who has iobuf.
+ *****************************************************************************/
+PUBLIC void put_iobuf(struct fs_req * r)
+{
+	assert(io_owner == r);
+	io_owner = 0;
+	r->r_state = RQ_RUN;
+}
+
+/*****************************************************************************
+ *                                start_io
+ *****************************************************************************/
+/**
+ * <Ring 1> Send a transfer to/from iobuf to the driver, without waiting for
+ * it to finish. The caller then parks the request.
+ *
+ * @param r         Who has iobuf.
+ * @param io_type   DEV_READ or DEV_WRITE.
+ * @param dev       Device nr.
+ * @param sect      1st sector.
+ * @param nr_sects  How many sectors.
+ *****************************************************************************/
+PUBLIC void start_io(struct fs_req * r, int io_type, int dev, int sect,
+		     int nr_sects)
+{
+	MESSAGE driver_msg;
+
+	assert(io_owner == r);
+	assert(nr_sects * SECTOR_SIZE <= IOBUF_SIZE);
+
+	driver_msg.type		= io_type;
+	driver_msg.DEVICE	= MINOR(dev);
+	driver_msg.POSITION	= (u64)sect * SECTOR_SIZE;
+	driver_msg.BUF		= iobuf;
+	driver_msg.CNT		= nr_sects * SECTOR_SIZE;
+	driver_msg.PROC_NR	= TASK_FS;
+	io_driver = dd_map[MAJOR(dev)].driver_nr;
+	assert(io_driver != INVALID_DRIVER);
+	send_recv(SEND, io_driver, &driver_msg);
+
+	r->r_state = RQ_IO;
+}
+
+/*****************************************************************************
+ *                                wait_io
+ *****************************************************************************/
+/**
+ * <Ring 1> If a transfer through iobuf is on the way, wait for it. Must be
+ * called before FS sends anything else to a driver: the driver would be
+ * sending its reply to FS at the same time.
+ *
+ *****************************************************************************/
+PUBLIC void wait_io()
+{
+	MESSAGE msg;
+
+	if (io_owner && io_owner->r_state == RQ_IO) {
+		send_recv(RECEIVE, io_driver, &msg);
+		io_owner->r_state = RQ_IO_DONE;
+	}
+}
+
+/*****************************************************************************
+ *                                io_reply
+ *****************************************************************************/
+/**
+ * <Ring 1> Check whether a message received by FS is the reply to the
+ * transfer through iobuf.
+ *
+ * @param m  The message.
+ *
+ * @return  Nonzero if it is, then run_parked() should be called.
+ *****************************************************************************/
+PUBLIC int io_reply(MESSAGE * m)
+{
+	if (io_owner && io_owner->r_state == RQ_IO &&
+	    m->source == io_driver) {
+		io_owner->r_state = RQ_IO_DONE;
+		return 1;
+	}
+	return 0;
+}
+
+/*****************************************************************************
+ *                                run_parked
+ *****************************************************************************/
+/**
+ * <Ring 1> Let the parked requests go on as far as they can: the one whose
+ * transfer is done, then the ones waiting for iobuf, until a transfer is on
+ * the way again.
+ *
+ *****************************************************************************/
+PUBLIC void run_parked()
+{
+	while (1) {
+		struct fs_req * r;
+
+		if (io_owner && io_owner->r_state == RQ_IO_DONE) {
+			r = io_owner;
+		}
+		else if (!io_owner && io_queue) {
+			r = io_queue;
+			io_queue = r->r_next;
+		}
+		else {
+			break;
+		}
+
+		rdwt_resume(r);
+	}
+}
+
+/*****************************************************************************
+ *                                defer_msg
+ *****************************************************************************/
+/**
+ * <Ring 1> Keep fs_msg, to be handled again when a parked request has
+ * finished. The handler must not have changed anything yet.
+ *
+ *****************************************************************************/
+PUBLIC void defer_msg()
+{
+	int src = fs_msg.source;
+
+	assert(dstate[src] == DM_NONE);
+	dmsg[src] = fs_msg;
+	dgroup[src] = proc_table[src].p_tgid;
+	dstate[src] = DM_WAIT;
+
+	/* no reply for now */
+	fs_msg.type = SUSPEND_PROC;
+}
+
+/*****************************************************************************
+ *                                wake_deferred
+ *****************************************************************************/
+/**
+ * <Ring 1> A parked request has finished, the deferred messages get another
+ * chance.
+ *
+ *****************************************************************************/
+PUBLIC void wake_deferred()
+{
+	int i;
+	for (i = 0; i < NR_TASKS + NR_PROCS; i++)
+		if (dstate[i] == DM_WAIT)
+			dstate[i] = DM_RETRY;
+}
+
+/*****************************************************************************
+ *                                next_deferred
+ *****************************************************************************/
+/**
+ * <Ring 1> Get a deferred message which may be handled now.
+ *
+ * @param m  Where the message goes.
+ *
+ * @return  Nonzero if there is one.
+ *****************************************************************************/
+PUBLIC int next_deferred(MESSAGE * m)
+{
+	int i;
+	for (i = 0; i < NR_TASKS + NR_PROCS; i++) {
+		if (dstate[i] == DM_RETRY) {
+			*m = dmsg[i];
+			dstate[i] = DM_NONE;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*****************************************************************************
+ *                                cancel_parked
+ *****************************************************************************/
+/**
+ * <Ring 1> A proc is exiting: drop its deferred messages, and make sure its
+ * parked requests never touch its memory again. A group leader exits
+ * together with its threads, a thread alone.
+ *
+ * @param pid  The proc.
+ *
+ * @return  Nonzero if some of the requests are still parked. They are gone
+ *          when they have finished, see rdwt_finish().
+ *****************************************************************************/
+PUBLIC int cancel_parked(int pid)
+{
+	int i;
+	int parked = 0;
+	int group = (proc_table[pid].p_tgid == pid);
+
+	for (i = 0; i < NR_TASKS + NR_PROCS; i++) {
+		if (reqs[i].r_state != RQ_FREE &&
+		    (group ? reqs[i].r_caller == &proc_table[pid] : i == pid)) {
+			reqs[i].r_dead = 1;
+			parked = 1;
+		}
+		if (dstate[i] != DM_NONE && (group ? dgroup[i] == pid : i == pid))
+			dstate[i] = DM_NONE;
+	}
+	return parked;
+}
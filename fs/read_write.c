@@ -19,16 +19,36 @@
 #include "global.h"
 #include "keyboard.h"
 #include "proto.h"
+#include "log.h"
 
 
+PRIVATE int	rdwt_run(struct fs_req * r);
+PRIVATE void	rdwt_io_done(struct fs_req * r);
+PRIVATE void	rdwt_copy(struct fs_req * r, u8 * p, int bytes);
+PRIVATE void	rdwt_advance(struct fs_req * r, int bytes);
+PRIVATE int	rdwt_finish(struct fs_req * r);
+PRIVATE void	read_partial(int dev, int sect, u8 * dst);
+PRIVATE struct inode *	range_inode(int fd);
+PRIVATE void	copy_bytes(struct inode * in, int ipos, struct inode * out,
+			   int opos, int len);
+
 /*****************************************************************************
  *                                do_rdwt
  *****************************************************************************/
 /**
  * Read/Write file and return byte count read/written.
  *
- * Sector map is not needed to update, since the sectors for the file have been
- * allocated and the bits are set when the file was created.
+ * Sectors are allocated by grow_file() as a write goes past the ones the
+ * file already has.
+ *
+ * The data which has to go to/from the disk goes through iobuf, and the
+ * request is parked (see fs/park.c) meanwhile; a READ/WRITE of a file which
+ * has a parked one is deferred until that one finishes.
+ *
+ * RW_FLAGS may ask for pread()/pwrite() (RW_AT: the data is at POSITION and
+ * fd_pos doesn't move) and/or readv()/writev() (RW_VEC: BUF is an array of
+ * CNT struct iovec, which are filled/drained in order). Neither makes sense
+ * for a character device. A write may not start beyond the end of the file.
  * 
  * @return How many bytes have been read/written.
  *****************************************************************************/
@@ -37,6 +57,7 @@ PUBLIC int do_rdwt()
 	int fd = fs_msg.FD;	/**< file descriptor. */
 	void * buf = fs_msg.BUF;/**< r/w buffer */
 	int len = fs_msg.CNT;	/**< r/w bytes */
+	int flags = fs_msg.RW_FLAGS;
 
 	int src = fs_msg.source;		/* caller proc nr. */
 
@@ -57,6 +78,9 @@ PUBLIC int do_rdwt()
 	// 字符设备文件
 	// 如果是字符设备文件，那FS将不去磁盘读写数据块，而是把读写请求转发给对应的设备驱动（TTY 驱动）去完成
 	if (imode == I_CHAR_SPECIAL) {
+		if (flags)
+			return -1;
+
 		int t = fs_msg.type == READ ? DEV_READ : DEV_WRITE;
 		fs_msg.type = t;
 
@@ -77,66 +101,562 @@ PUBLIC int do_rdwt()
 		assert(pin->i_mode == I_REGULAR || pin->i_mode == I_DIRECTORY);
 		assert((fs_msg.type == READ) || (fs_msg.type == WRITE));
 
+		/* directories are only changed through dir_add()/dir_remove() */
+		if (fs_msg.type == WRITE && pin->i_mode == I_DIRECTORY)
+			return -1;
+
+		/* one READ/WRITE of a file at a time */
+		if (parked_on(pin)) {
+			defer_msg();
+			return 0;
+		}
+
+		/* the caller's buffers */
+		struct iovec iov[IOV_MAX];
+		int nr_iov = 1;
+		if (flags & RW_VEC) {
+			int i;
+			nr_iov = len;
+			if (nr_iov <= 0 || nr_iov > IOV_MAX)
+				return -1;
+			phys_copy((void*)va2la(TASK_FS, iov),
+				  (void*)va2la(src, buf),
+				  nr_iov * sizeof(struct iovec));
+			for (len = 0, i = 0; i < nr_iov; i++) {
+				if (iov[i].iov_len < 0)
+					return -1;
+				len += iov[i].iov_len;
+			}
+		}
+		else {
+			iov[0].iov_base = buf;
+			iov[0].iov_len = len;
+		}
+
+		if (flags & RW_AT) {
+			if ((int)fs_msg.POSITION < 0)
+				return -1;
+			pos = (int)fs_msg.POSITION;
+		}
+
+		struct file_desc * pfd = pcaller->filp[fd];
 		int pos_end;
 		if (fs_msg.type == READ) {
 			if (pos >= pin->i_size)
 				return 0;
 			pos_end = min(pos + len, pin->i_size);
+
+			/* sequential reads widen the read-ahead window */
+			if (pos == pfd->fd_ra_pos)
+				pfd->fd_ra_win = pfd->fd_ra_win ?
+					min(pfd->fd_ra_win * 2, RA_MAX_SECTS) :
+					RA_MIN_SECTS;
+			else
+				pfd->fd_ra_win = 0;
+			pfd->fd_ra_pos = pos_end;
+		}
+		else {		/* WRITE */
+			/* no holes: the sectors between EOF and pos would
+			 * hold stale data, see do_lseek() */
+			if (pos > pin->i_size)
+				return -1;
+
+			/* allocate sectors on demand */
+			int nr_sects = grow_file(pin, (pos + len + SECTOR_SIZE - 1)
+						 >> SECTOR_SIZE_SHIFT);
+			pos_end = min(pos + len, nr_sects * SECTOR_SIZE);
+
+			/* a verified checksum no longer holds */
+			pin->i_gen++;
+			ht_dirty(pin, pos, pos_end - pos);
+			ck_forget(pin);
 		}
-		else		/* WRITE */
-		// 边界条件是给文件分配的扇区的大小而不是文件现在的大小（？）
-			pos_end = min(pos + len, pin->i_nr_sects * SECTOR_SIZE);
 
+		struct fs_req * r = get_req(src);
+		r->r_type	= fs_msg.type;
+		r->r_src	= src;
+		r->r_caller	= pcaller;
+		r->r_pfd	= pfd;
+		r->r_pin	= pin;
+		memcpy(r->r_iov, iov, nr_iov * sizeof(struct iovec));
+		r->r_nr_iov	= nr_iov;
+		r->r_at		= flags & RW_AT;
+		r->r_pos	= pos;
+		r->r_left	= max(pos_end - pos, 0);
+
+		/* hold them, the caller may close() or exit() meanwhile */
+		pfd->fd_cnt++;
+		pin->i_cnt++;
+
+		if (!rdwt_run(r)) {
+			/* the reply is sent by rdwt_finish() */
+			r->r_parked = 1;
+			fs_msg.type = SUSPEND_PROC;
+			return 0;
+		}
+		return rdwt_finish(r);
+	}
+}
+
+/*****************************************************************************
+ *                                rdwt_resume
+ *****************************************************************************/
+/**
+ * <Ring 1> Go on with a parked READ/WRITE, either because its transfer is
+ * done or because iobuf is free now.
+ * 
+ * @param r  The request.
+ *****************************************************************************/
+PUBLIC void rdwt_resume(struct fs_req * r)
+{
+	if (r->r_state == RQ_IO_DONE)
+		rdwt_io_done(r);
+
+	if (rdwt_run(r))
+		rdwt_finish(r);
+}
+
+/*****************************************************************************
+ *                                rdwt_run
+ *****************************************************************************/
+/**
+ * R/W as much as possible without waiting for the disk.
+ * 
+ * @param r  The request.
+ * 
+ * @return Nonzero if the request is finished, 0 if it is parked.
+ *****************************************************************************/
+PRIVATE int rdwt_run(struct fs_req * r)
+{
+	struct inode * pin = r->r_pin;
+	struct file_desc * pfd = r->r_pfd;
+
+	r->r_state = RQ_RUN;
+	while (r->r_left > 0 && !r->r_dead) {
+		int pos = r->r_pos;
 		int off = pos % SECTOR_SIZE;
-		int rw_sect_min=pin->i_start_sect+(pos>>SECTOR_SIZE_SHIFT);
-		int rw_sect_max=pin->i_start_sect+(pos_end>>SECTOR_SIZE_SHIFT);
-
-		int chunk = min(rw_sect_max - rw_sect_min + 1,
-				FSBUF_SIZE >> SECTOR_SIZE_SHIFT);
-
-		int bytes_rw = 0;
-		int bytes_left = (fs_msg.type == READ) ? (pos_end - pos) : len;
-		int i;
-		for (i = rw_sect_min; i <= rw_sect_max; i += chunk) {
-			/* read/write this amount of bytes every time */
-			int bytes = min(bytes_left, chunk * SECTOR_SIZE - off);
-			rw_sector(DEV_READ,
-				  pin->i_dev,
-				  i * SECTOR_SIZE,
-				  chunk * SECTOR_SIZE,
-				  TASK_FS,
-				  fsbuf);
-
-			if (fs_msg.type == READ) {
-				phys_copy((void*)va2la(src, buf + bytes_rw),
-					  (void*)va2la(TASK_FS, fsbuf + off),
-					  bytes);
+		int run;
+		int sect = bmap(pin, pos >> SECTOR_SIZE_SHIFT, &run);
+		assert(sect);
+
+		/* read/write this amount of bytes every time */
+		int chunk = min(run, IOBUF_SIZE >> SECTOR_SIZE_SHIFT);
+		int bytes = min(r->r_left, chunk * SECTOR_SIZE - off);
+		chunk = (off + bytes + SECTOR_SIZE - 1) >> SECTOR_SIZE_SHIFT;
+
+		if (r->r_type == READ) {
+			struct buf * bp = peek_buf(pin->i_dev, sect);
+			if (bp) {
+				/* e.g. read ahead by an earlier call */
+				bytes = min(bytes, SECTOR_SIZE - off);
+				rdwt_copy(r, bp->b_data + off, bytes);
 			}
-			else {	/* WRITE */
-				phys_copy((void*)va2la(TASK_FS, fsbuf + off),
-					  (void*)va2la(src, buf + bytes_rw),
-					  bytes);
-				rw_sector(DEV_WRITE,
-					  pin->i_dev,
-					  i * SECTOR_SIZE,
-					  chunk * SECTOR_SIZE,
-					  TASK_FS,
-					  fsbuf);
+			else {
+				if (!get_iobuf(r))
+					return 0;
+
+				/* read the window ahead in the same command */
+				int lsect = pos >> SECTOR_SIZE_SHIFT;
+				int file_end = (pin->i_size + SECTOR_SIZE - 1)
+					>> SECTOR_SIZE_SHIFT;
+				int ra = min(pfd->fd_ra_win, run - chunk);
+				ra = min(ra, (IOBUF_SIZE >> SECTOR_SIZE_SHIFT)
+					 - chunk);
+				ra = max(min(ra, file_end - (lsect + chunk)), 0);
+
+				/* the cache may hold newer copies of these sectors */
+				sync_blocks(pin->i_dev, sect, chunk + ra);
+
+				r->r_sect  = sect;
+				r->r_chunk = chunk;
+				r->r_ra    = ra;
+				r->r_off   = off;
+				r->r_bytes = bytes;
+				start_io(r, DEV_READ, pin->i_dev, sect, chunk + ra);
+				return 0;
 			}
-			off = 0;
-			bytes_rw += bytes;
-			pcaller->filp[fd]->fd_pos += bytes;
-			bytes_left -= bytes;
 		}
+		else if (chunk <= WB_MAX_SECTS) {
+			/**
+			 * A small write only changes the cache, one
+			 * sector at a time; TASK FLUSH writes it back.
+			 */
+			bytes = min(bytes, SECTOR_SIZE - off);
+			int lpos = pos - off;
+			int part = off || bytes < SECTOR_SIZE;
+			struct buf * bp = get_buf(pin->i_dev, sect,
+						  part && lpos < pin->i_size);
+			if (part && lpos >= pin->i_size)
+				memset(bp->b_data, 0, SECTOR_SIZE);
+			rdwt_copy(r, bp->b_data + off, bytes);
+			bp->b_dirty = 1;
+		}
+		else {	/* WRITE */
+			if (!get_iobuf(r))
+				return 0;
+
+			/**
+			 * Sectors fully covered by the caller's data
+			 * are not read. Only the partial head and tail
+			 * are, and only if they hold any of the file;
+			 * otherwise they are cleared, iobuf still has
+			 * somebody else's data in it.
+			 */
+			int tail = (off + bytes) % SECTOR_SIZE;
+			int lpos = pos - off;
+			u8 * last = iobuf + (chunk - 1) * SECTOR_SIZE;
+			if (off) {
+				if (lpos < pin->i_size)
+					read_partial(pin->i_dev, sect, iobuf);
+				else
+					memset(iobuf, 0, SECTOR_SIZE);
+			}
+			if (tail && (chunk > 1 || !off)) {
+				if (lpos + (chunk - 1) * SECTOR_SIZE < pin->i_size)
+					read_partial(pin->i_dev, sect + chunk - 1,
+						     last);
+				else
+					memset(last, 0, SECTOR_SIZE);
+			}
+			rdwt_copy(r, iobuf + off, bytes);
+			inval_blocks(pin->i_dev, sect, chunk);
+
+			r->r_bytes = bytes;
+			start_io(r, DEV_WRITE, pin->i_dev, sect, chunk);
+			return 0;
+		}
+		rdwt_advance(r, bytes);
+	}
+
+	return 1;
+}
+
+/*****************************************************************************
+ *                                rdwt_io_done
+ *****************************************************************************/
+/**
+ * The transfer of a request is done: hand the data over and give iobuf
+ * back.
+ * 
+ * @param r  The request.
+ *****************************************************************************/
+PRIVATE void rdwt_io_done(struct fs_req * r)
+{
+	if (r->r_type == READ) {
+		if (!r->r_dead)
+			rdwt_copy(r, iobuf + r->r_off, r->r_bytes);
+
+		/* keep what the caller hasn't consumed */
+		if (r->r_pfd->fd_ra_win) {
+			int used = (r->r_off + r->r_bytes) >> SECTOR_SIZE_SHIFT;
+			fill_blocks(r->r_pin->i_dev, r->r_sect + used,
+				    r->r_chunk + r->r_ra - used,
+				    iobuf + used * SECTOR_SIZE);
+		}
+	}
+
+	put_iobuf(r);
+	rdwt_advance(r, r->r_bytes);
+}
+
+/*****************************************************************************
+ *                                rdwt_copy
+ *****************************************************************************/
+/**
+ * Copy the next `bytes' bytes between FS and the caller's buffers: into
+ * them for a READ, out of them for a WRITE.
+ * 
+ * @param r      The request.
+ * @param p      Where the bytes are in FS.
+ * @param bytes  How many, at most r->r_left.
+ *****************************************************************************/
+PRIVATE void rdwt_copy(struct fs_req * r, u8 * p, int bytes)
+{
+	int k = r->r_seg;
+	int off = r->r_seg_off;
+
+	while (bytes > 0) {
+		assert(k < r->r_nr_iov);
+		int n = min(bytes, r->r_iov[k].iov_len - off);
+		void * ubuf = (void*)va2la(r->r_src,
+					   (char*)r->r_iov[k].iov_base + off);
+		void * fbuf = (void*)va2la(TASK_FS, p);
+
+		if (r->r_type == READ)
+			phys_copy(ubuf, fbuf, n);
+		else
+			phys_copy(fbuf, ubuf, n);
+
+		p += n;
+		bytes -= n;
+		k++;
+		off = 0;
+	}
+}
+
+/*****************************************************************************
+ *                                rdwt_advance
+ *****************************************************************************/
+/**
+ * `bytes' more bytes have been read/written.
+ * 
+ *****************************************************************************/
+PRIVATE void rdwt_advance(struct fs_req * r, int bytes)
+{
+	r->r_pos += bytes;
+	r->r_done += bytes;
+	if (!r->r_at)
+		r->r_pfd->fd_pos += bytes;
+	r->r_left -= bytes;
 
-		if (fs_msg.type == WRITE &&
-		    pcaller->filp[fd]->fd_pos > pin->i_size) {
+	r->r_seg_off += bytes;
+	while (r->r_seg < r->r_nr_iov - 1 &&
+	       r->r_seg_off >= r->r_iov[r->r_seg].iov_len) {
+		r->r_seg_off -= r->r_iov[r->r_seg].iov_len;
+		r->r_seg++;
+	}
+}
+
+/*****************************************************************************
+ *                                rdwt_finish
+ *****************************************************************************/
+/**
+ * Finish a READ/WRITE. If it has been parked, reply to the caller here.
+ * 
+ * @param r  The request.
+ * 
+ * @return How many bytes have been read/written.
+ *****************************************************************************/
+PRIVATE int rdwt_finish(struct fs_req * r)
+{
+	struct inode * pin = r->r_pin;
+	struct file_desc * pfd = r->r_pfd;
+	int bytes_rw = r->r_done;
+
+	if (r->r_type == WRITE) {
+		/* a checksum may have been verified while it was parked */
+		pin->i_gen++;
+		ht_dirty(pin, r->r_pos - r->r_done, r->r_done);
+
+		if (r->r_pos > pin->i_size) {
 			/* update inode::size */
-			pin->i_size = pcaller->filp[fd]->fd_pos;
+			pin->i_size = r->r_pos;
 			/* write the updated i-node back to disk */
 			sync_inode(pin);
 		}
+	}
+
+	put_inode(pin);
+	if (--pfd->fd_cnt == 0)
+		pfd->fd_inode = 0;
+
+	if (r->r_parked) {
+		/* unless the caller is gone, e.g. a thread killed meanwhile */
+		struct proc * p = &proc_table[r->r_src];
+		if (!r->r_dead && (p->p_flags & RECEIVING) &&
+		    p->p_recvfrom == TASK_FS) {
+			MESSAGE msg;
+			msg.type = SYSCALL_RET;
+			msg.CNT = bytes_rw;
+			send_recv(SEND, r->r_src, &msg);
+		}
+		log_fs_event(r->r_type, r->r_src, bytes_rw);
+	}
+
+	r->r_state = RQ_FREE;
+	wake_deferred();
+	return bytes_rw;
+}
+
+/*****************************************************************************
+ *                                read_partial
+ *****************************************************************************/
+/**
+ * Read a sector which a write covers only partly, so that the bytes the
+ * write doesn't cover are written back unchanged.
+ * 
+ * @param dev   Device nr.
+ * @param sect  Sector nr.
+ * @param dst   Where in iobuf the sector goes.
+ *****************************************************************************/
+PRIVATE void read_partial(int dev, int sect, u8 * dst)
+{
+	struct buf * bp = get_buf(dev, sect, 1);
+	memcpy(dst, bp->b_data, SECTOR_SIZE);
+}
+
+/*****************************************************************************
+ *                                do_copy_range
+ *****************************************************************************/
+/**
+ * Handle the message COPY_RANGE: copy CNT bytes at POSITION of FD to
+ * POSITION_OUT of FD_OUT, through the buffer cache, without the data ever
+ * leaving FS. The file offsets don't move.
+ *
+ * The two may be the same file and the ranges may overlap, it works like
+ * memmove(); so bytes are inserted into a file by moving its tail up and
+ * deleted by moving it down (and truncating). POSITION_OUT may not be
+ * beyond the end of FD_OUT.
+ * 
+ * @return How many bytes have been copied, -1 if the request is invalid.
+ *****************************************************************************/
+PUBLIC int do_copy_range()
+{
+	struct inode * in = range_inode(fs_msg.FD);
+	struct inode * out = range_inode(fs_msg.FD_OUT);
+	int ipos = (int)fs_msg.POSITION;
+	int opos = (int)fs_msg.POSITION_OUT;
+	int len = fs_msg.CNT;
+
+	if (!in || !out || ipos < 0 || opos < 0 || len < 0)
+		return -1;
+
+	/* a parked READ/WRITE may be using the sectors */
+	if (parked_on(in) || parked_on(out)) {
+		defer_msg();
+		return 0;
+	}
+
+	/* no holes, as in do_rdwt() */
+	if (opos > out->i_size)
+		return -1;
+
+	/* no more than there is, and there is room for */
+	len = min(len, max((int)in->i_size - ipos, 0));
+	int nr_sects = grow_file(out, (opos + len + SECTOR_SIZE - 1)
+				 >> SECTOR_SIZE_SHIFT);
+	len = max(min(len, nr_sects * SECTOR_SIZE - opos), 0);
+	if (len == 0)
+		return 0;
+
+	/* a verified checksum no longer holds */
+	out->i_gen++;
+	ht_dirty(out, opos, len);
+	ck_forget(out);
+
+	int size = out->i_size;
+	copy_bytes(in, ipos, out, opos, len);
+	if (out->i_size != size)
+		sync_inode(out);
+
+	return len;
+}
+
+/*****************************************************************************
+ *                                range_inode
+ *****************************************************************************/
+/**
+ * The regular file behind an fd of the caller, for COPY_RANGE.
+ * 
+ *****************************************************************************/
+PRIVATE struct inode * range_inode(int fd)
+{
+	if (fd < 0 || fd >= NR_FILES || !pcaller->filp[fd])
+		return 0;
+	if (!(pcaller->filp[fd]->fd_mode & O_RDWR))
+		return 0;
+
+	struct inode * pin = pcaller->filp[fd]->fd_inode;
+	if (!pin || pin->i_mode != I_REGULAR)
+		return 0;
+	return pin;
+}
+
+/*****************************************************************************
+ *                                copy_bytes
+ *****************************************************************************/
+/**
+ * Copy bytes between files through the buffer cache, at most a sector at a
+ * time. Backwards if the ranges overlap and the destination is above the
+ * source.
+ * 
+ * @param in    The source, which has the bytes.
+ * @param ipos  Where they are.
+ * @param out   The destination, which has the sectors.
+ * @param opos  Where they go.
+ * @param len   How many.
+ *****************************************************************************/
+PRIVATE void copy_bytes(struct inode * in, int ipos, struct inode * out,
+			int opos, int len)
+{
+	u8 tmp[SECTOR_SIZE];
+	int back = (in == out && opos > ipos && opos < ipos + len);
+	int done;
+
+	for (done = 0; done < len; ) {
+		int left = len - done;
+		int s, d, n;
+
+		if (!back) {
+			s = ipos + done;
+			d = opos + done;
+			n = min(left, SECTOR_SIZE - s % SECTOR_SIZE);
+			n = min(n, SECTOR_SIZE - d % SECTOR_SIZE);
+		}
+		else {	/* from the end: s and d are where the step ends */
+			s = ipos + left;
+			d = opos + left;
+			n = min(left, (s - 1) % SECTOR_SIZE + 1);
+			n = min(n, (d - 1) % SECTOR_SIZE + 1);
+			s -= n;
+			d -= n;
+		}
+
+		cache_rw(in, s, TASK_FS, (char*)tmp, n, 0);
+		cache_rw(out, d, TASK_FS, (char*)tmp, n, 1);
+		done += n;
+	}
+}
+
+/*****************************************************************************
+ *                                cache_rw
+ *****************************************************************************/
+/**
+ * <Ring 1> Copy bytes between a file and the memory of a proc through the
+ * buffer cache. Written sectors are dirtied like those of a small write
+ * (see rdwt_run()) and written back by TASK FLUSH.
+ * 
+ * @param pin    I-node of the file. The sectors must have been allocated,
+ *               and a read must not go past the end of the file.
+ * @param pos    Where in the file.
+ * @param pid    Whose memory.
+ * @param buf    Where in it.
+ * @param len    How many bytes.
+ * @param write  Nonzero: from the memory to the file, which grows if the
+ *               bytes go past its end.
+ *****************************************************************************/
+PUBLIC void cache_rw(struct inode * pin, int pos, int pid, char * buf,
+		     int len, int write)
+{
+	while (len > 0) {
+		int off = pos % SECTOR_SIZE;
+		int n = min(len, SECTOR_SIZE - off);
+		int sect = bmap(pin, pos >> SECTOR_SIZE_SHIFT, 0);
+		struct buf * bp;
+
+		assert(sect);
+		if (!write) {
+			bp = get_buf(pin->i_dev, sect, 1);
+			phys_copy((void*)va2la(pid, buf),
+				  (void*)va2la(TASK_FS, bp->b_data + off), n);
+		}
+		else {
+			int lpos = pos - off;
+			int part = off || n < SECTOR_SIZE;
+			bp = get_buf(pin->i_dev, sect, part && lpos < pin->i_size);
+			if (part && lpos >= pin->i_size)
+				memset(bp->b_data, 0, SECTOR_SIZE);
+			phys_copy((void*)va2la(TASK_FS, bp->b_data + off),
+				  (void*)va2la(pid, buf), n);
+			bp->b_dirty = 1;
+
+			/* a later step may fill the rest of the sector */
+			if (pos + n > pin->i_size)
+				pin->i_size = pos + n;
+		}
 
-		return bytes_rw;
+		pos += n;
+		buf += n;
+		len -= n;
 	}
 }
@@ -0,0 +1,119 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   sync.c
+ * @brief  Write-back of the FS caches.
+ *
+ * Writes only change the buffer cache and the i-node cache. TASK FLUSH is
+ * woken by the clock every FLUSH_INTERVAL_TICKS and asks FS to write the
+ * dirty stuff back, the way the `update' daemon of UNIX calls sync(). A
+ * process which needs its data on the disk right away calls sync() or
+ * fsync().
+ *
+ * TASK FLUSH is also the one which refreshes, in the background, the
+ * checksums Init has asked for (see do_refresh_checksums()).
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                task_flush
+ *****************************************************************************/
+/**
+ * <Ring 1> The main loop of TASK FLUSH.
+ *
+ *****************************************************************************/
+PUBLIC void task_flush()
+{
+	MESSAGE msg;
+
+	while (1) {
+		send_recv(RECEIVE, INTERRUPT, &msg);
+
+		reset_msg(&msg);
+		msg.type = SYNC;
+		send_recv(BOTH, TASK_FS, &msg);
+
+		/* one at a time, so FS keeps serving the others in between */
+		do {
+			reset_msg(&msg);
+			msg.type = REFRESH_CHECKSUMS;
+			send_recv(BOTH, TASK_FS, &msg);
+		} while (msg.RETVAL > 0);
+	}
+}
+
+/*****************************************************************************
+ *                                sync_all
+ *****************************************************************************/
+/**
+ * <Ring 1> Write all dirty i-nodes, bitmaps and sectors back. Data goes
+ * first, so that committed metadata never points at stale sectors.
+ *
+ *****************************************************************************/
+PUBLIC void sync_all()
+{
+	sync_inodes();
+	sync_bitmaps();
+	sync_blocks(NO_DEV, 0, 0);
+	journal_commit();
+}
+
+/*****************************************************************************
+ *                                do_sync
+ *****************************************************************************/
+/**
+ * Handle the message SYNC.
+ *
+ * @return Zero.
+ *****************************************************************************/
+PUBLIC int do_sync()
+{
+	sync_all();
+	return 0;
+}
+
+/*****************************************************************************
+ *                                do_fsync
+ *****************************************************************************/
+/**
+ * Handle the message FSYNC: write back the data sectors of a file (only
+ * those, not the whole cache), then the metadata.
+ *
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_fsync()
+{
+	int fd = fs_msg.FD;
+
+	if (fd < 0 || fd >= NR_FILES || !pcaller->filp[fd])
+		return -1;
+
+	struct inode * pin = pcaller->filp[fd]->fd_inode;
+	if (pin->i_mode == I_REGULAR) {
+		int nr_sects = file_sects(pin);
+		int lsect;
+		int run;
+		for (lsect = 0; lsect < nr_sects; lsect += run) {
+			int sect = bmap(pin, lsect, &run);
+			sync_blocks(pin->i_dev, sect, run);
+		}
+	}
+
+	/* the metadata is committed as a whole */
+	sync_inodes();
+	sync_bitmaps();
+	journal_commit();
+	return 0;
+}
@@ -0,0 +1,70 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   hash.h
+ * @brief  Keyed hash functions, see lib/hash.c.
+ *****************************************************************************
+ *****************************************************************************/
+
+#ifndef	_ORANGES_HASH_H_
+#define	_ORANGES_HASH_H_
+
+#define	HASH_BLOCK_SIZE		64	/* both MD5 and BLAKE2s */
+#define	HASH_MAX_DIGEST		32
+#define	HASH_MAX_KEY		32
+
+struct md5_state {
+	u32	state[4];
+	u32	count[2];		/* bytes so far, low word first */
+	u8	buffer[HASH_BLOCK_SIZE];
+};
+
+struct blake2s_state {
+	u32	h[8];
+	u32	t[2];			/* bytes so far, low word first */
+	u8	buffer[HASH_BLOCK_SIZE];
+	int	buflen;
+	int	outlen;
+};
+
+/**
+ * @struct hash_ctx
+ * @brief  A hash being computed.
+ */
+typedef struct hash_ctx {
+	const struct hash_alg *	alg;
+	union {
+		struct {
+			struct md5_state	md5;
+			u8	okey[HASH_BLOCK_SIZE];	/* key ^ opad */
+			int	outlen;
+		} hmac;
+		struct blake2s_state	b2s;
+	} u;
+} HASH_CTX;
+
+/**
+ * @struct hash_alg
+ * @brief  A keyed hash function.
+ *
+ * The key is at most HASH_MAX_KEY bytes, the digest at most `max_digest'.
+ */
+struct hash_alg {
+	const char *	name;
+	int		max_digest;
+	void		(*init)(HASH_CTX * ctx, const u8 * key, int keylen,
+				int outlen);
+	void		(*update)(HASH_CTX * ctx, const u8 * p, int len);
+	void		(*final)(HASH_CTX * ctx, u8 * digest);
+};
+
+extern const struct hash_alg	hmac_md5_alg;
+extern const struct hash_alg	blake2s_alg;
+
+/* lib/hash.c */
+PUBLIC const struct hash_alg *	hash_find	(const char * name);
+PUBLIC void	hash_init	(HASH_CTX * ctx, const struct hash_alg * alg,
+				 const u8 * key, int keylen, int outlen);
+PUBLIC void	hash_update	(HASH_CTX * ctx, const void * p, int len);
+PUBLIC void	hash_final	(HASH_CTX * ctx, u8 * digest);
+
+#endif /* _ORANGES_HASH_H_ */
@@ -36,8 +36,24 @@ void assertion_failure(char *exp, char *file, char *base_file, int line);
 #define SEEK_CUR	2
 #define SEEK_END	3
 
+/* mmap() */
+#define	PROT_READ	1
+#define	PROT_WRITE	2	/* written back to the file */
+
 #define	MAX_PATH	128
 
+/* at most this many buffers in a readv()/writev() */
+#define	IOV_MAX		16
+
+/**
+ * @struct iovec
+ * @brief  A buffer of readv()/writev().
+ */
+struct iovec {
+	void *	iov_base;
+	int	iov_len;
+};
+
 /**
  * @struct stat
  * @brief  File status, returned by syscall stat();
@@ -50,6 +66,16 @@ struct stat {
 	int st_size;		/* file size */
 };
 
+/**
+ * @struct dirent
+ * @brief  A directory entry with the status of its file, returned by
+ *         syscall readdir().
+ */
+struct dirent {
+	struct stat d_st;
+	char d_name[16];	/* MAX_FILENAME_LEN of fs.h and a 0 */
+};
+
 /**
  * @struct time
  * @brief  RTC time from CMOS.
@@ -75,6 +101,34 @@ struct proc_info {
 	char name[PROC_NAME_LEN];
 };
 
+#define MAX_MEM_INFO 64
+
+/* owners other than a pid */
+#define MEM_OWNER_KERNEL	(-1)
+#define MEM_OWNER_NONE		(-2)	/* not usable RAM */
+#define MEM_OWNER_SHM		(-3)	/* shared memory segments */
+
+/**
+ * @struct mem_stat
+ * @brief  Physical memory usage, returned by syscall memstat();
+ */
+struct mem_info {
+	int base;		/* physical address of the region */
+	int size;		/* bytes */
+	int owner;		/* pid of the owner, or MEM_OWNER_xxx */
+	char name[PROC_NAME_LEN];
+};
+
+struct mem_stat {
+	int total;		/* bytes of usable RAM */
+	int used;		/* bytes of it accounted to some owner */
+	int nr_regions;		/* valid entries in regions[] */
+	struct mem_info regions[MAX_MEM_INFO];
+	int bc_hits;		/* buffer cache: lookups served from memory */
+	int bc_misses;		/* lookups which went to the disk */
+	int bc_writes;		/* sectors written back */
+};
+
 #define  BCD_TO_DEC(x)      ( (x >> 4) * 10 + (x & 0x0f) )
 
 /*========================*
@@ -134,15 +188,38 @@ PUBLIC int	read		(int fd, void *buf, int count);
 /* lib/write.c */
 PUBLIC int	write		(int fd, const void *buf, int count);
 
+/* lib/pread.c */
+PUBLIC	int	pread		(int fd, void *buf, int count, int offset);
+PUBLIC	int	pwrite		(int fd, const void *buf, int count,
+				 int offset);
+
+/* lib/readv.c */
+PUBLIC	int	readv		(int fd, const struct iovec *iov, int iovcnt);
+PUBLIC	int	writev		(int fd, const struct iovec *iov, int iovcnt);
+
+/* lib/copyrange.c */
+PUBLIC	int	copy_range	(int fd_in, int off_in, int fd_out, int off_out,
+				 int len);
+
 /* lib/lseek.c */
 PUBLIC	int	lseek		(int fd, int offset, int whence);
 
 /* lib/unlink.c */
 PUBLIC	int	unlink		(const char *pathname);
 
+/* lib/mkdir.c */
+PUBLIC	int	mkdir		(const char *pathname);
+
+/* lib/sync.c */
+PUBLIC	void	sync		();
+PUBLIC	int	fsync		(int fd);
+
 /* lib/getpid.c */
 PUBLIC int	getpid		();
 
+/* lib/getticks.c */
+PUBLIC int	get_ticks	();
+
 /* lib/fork.c */
 PUBLIC int	fork		();
 
@@ -159,6 +236,10 @@ PUBLIC int	execv		(const char * path, char * argv[]);
 
 /* lib/stat.c */
 PUBLIC int	stat		(const char *path, struct stat *buf);
+PUBLIC int	fstat		(int fd, struct stat *buf);
+
+/* lib/readdir.c */
+PUBLIC int	readdir		(int fd, struct dirent *buf, int nr);
 
 /* lib/filecheck.c */
 // PUBLIC int	calc_checksum	(const char *path, char *md5_buf);
@@ -168,9 +249,30 @@ PUBLIC int	refresh_checksums	();
 /* lib/getprocs.c */
 PUBLIC int	get_procs	(struct proc_info *buf, int max);
 
+/* lib/memstat.c */
+PUBLIC int	memstat		(struct mem_stat *buf);
+
 /* lib/clear.c */
 PUBLIC int	clear_screen_cmd	();
 
+/* lib/thread.c */
+PUBLIC int	thread_create	(void (*fn)(void *), void * arg,
+				 void * stack, int stack_size);
+
+/* lib/futex.c */
+PUBLIC int	futex_wait	(int * addr, int val);
+PUBLIC int	futex_wake	(int * addr, int nr);
+
+/* lib/shm.c */
+PUBLIC int	shmget		(int key, int size);
+PUBLIC void *	shmat		(int id);
+PUBLIC int	shmdt		(void * addr);
+
+/* lib/mmap.c */
+PUBLIC void *	mmap		(int fd, int offset, int len, int prot);
+PUBLIC int	msync		(void * addr);
+PUBLIC int	munmap		(void * addr);
+
 /* lib/kill.c */
 PUBLIC int	kill		(int pid);
 
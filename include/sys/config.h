@@ -27,6 +27,21 @@
 #define	BI_MAG				0
 #define	BI_MEM_SIZE			1
 #define	BI_KERNEL_FILE			2
+#define	BI_NR_MEM_RANGES		3
+#define	BI_MEM_RANGES			4	/* struct mem_range[] */
+
+/**
+ * At most this many entries of the BIOS E820 memory map are handed over by
+ * the loader, corresponding with boot/include/load.inc::MEM_CHK_BUF_ENTRIES.
+ */
+#define	MAX_MEM_RANGES			12
+
+/**
+ * page directory & page tables built by the loader, corresponding with
+ * boot/include/load.inc. One page table maps 4MB of RAM.
+ */
+#define	PAGE_DIR_BASE			0x100000
+#define	PAGE_TBL_BASE			0x101000
 
 /**
  * corresponding with boot/include/load.inc::ROOT_BASE, which should
@@ -49,5 +64,20 @@
 #define MEMSET_LOG_SECTS
 #define	NR_SECTS_FOR_LOG		NR_DEFAULT_FILE_SECTS
 
+/*
+ * metadata journal, right below the disk log
+ */
+#define	NR_JOURNAL_SECTS		(NR_JNL_BATCH + 2)
+
+/*
+ * write-back of the FS buffer cache
+ */
+#define	FLUSH_INTERVAL_TICKS		300	/* 3 seconds at 100Hz */
+
+/*
+ * keyed hash of the file checksums, see lib/hash.c (or hmac_md5_alg)
+ */
+#define	CHECKSUM_HASH			blake2s_alg
+
 // sec
 // #define ENABLE_CANARY
@@ -138,7 +138,8 @@
 #define TASK_FS		3
 #define TASK_MM		4
 #define TASK_LOG	5
-#define INIT		6
+#define TASK_FLUSH	6
+#define INIT		7
 #define ANY		(NR_TASKS + NR_PROCS + 10)
 #define NO_TASK		(NR_TASKS + NR_PROCS + 20)
 
@@ -171,17 +172,21 @@ enum msgtype {
 	GET_TICKS, GET_PID, GET_RTC_TIME, GET_PROCS, CLEAR_SCREEN,
 
 	/* FS */
-	OPEN, CLOSE, READ, WRITE, LSEEK, STAT, UNLINK,
+	OPEN, CLOSE, READ, WRITE, LSEEK, STAT, FSTAT, UNLINK,
 	VERIFY_CHECKSUM, REFRESH_CHECKSUMS,
 	// CALC_CHECKSUM, VERIFY_CHECKSUM, REFRESH_CHECKSUMS,
-	TRUNCATE,
+	TRUNCATE, MKDIR, SYNC, FSYNC, COPY_RANGE, READDIR,
+	FMAP_OPEN, FMAP_WRITE, FMAP_CLOSE,
 
 	/* FS & TTY */
 	SUSPEND_PROC, RESUME_PROC,
 
 	/* MM */
 	EXEC, WAIT,
-	KILL,
+	KILL, MEMSTAT,
+	THREAD_CREATE, FUTEX_WAIT, FUTEX_WAKE,
+	SHM_GET, SHM_AT, SHM_DT,
+	MMAP, MSYNC,
 
 	/* FS & MM */
 	FORK, EXIT,
@@ -212,10 +217,22 @@ enum msgtype {
 #define	BUF		u.m3.m3p2
 #define	OFFSET		u.m3.m3i2
 #define	WHENCE		u.m3.m3i3
+#define	RW_FLAGS	u.m3.m3i4
+#define	FD_OUT		u.m3.m3i3	/* COPY_RANGE */
+#define	POSITION_OUT	u.m3.m3l2
+
+/* RW_FLAGS of READ/WRITE */
+#define	RW_AT		1	/* at POSITION, the fd's offset is left alone */
+#define	RW_VEC		2	/* BUF is a struct iovec[CNT] */
 
 #define	PID		u.m3.m3i2
 #define	RETVAL		u.m3.m3i1
 #define	STATUS		u.m3.m3i1
+#define	ENTRY		u.m3.m3p1
+#define	STACK		u.m3.m3p2
+#define	SHM_KEY		u.m3.m3i3
+#define	SHM_ID		u.m3.m3i3
+#define	MAP_PROT	u.m3.m3i3
 
 
 
@@ -281,7 +298,22 @@ enum msgtype {
 #define	NR_FILES	64
 #define	NR_FILE_DESC	64	/* FIXME */
 #define	NR_INODE	64	/* FIXME */
+#define	NR_INODE_HASH	32
 #define	NR_SUPER_BLOCK	8
+#define	NR_BUF		512	/* sectors in the buffer cache */
+#define	NR_BUF_HASH	128
+#define	RA_MIN_SECTS	8	/* read-ahead window */
+#define	RA_MAX_SECTS	128
+#define	WB_MAX_SECTS	16	/* smaller writes are written back later */
+#define	NR_DENTRY	128	/* names in the dentry cache */
+#define	NR_DENTRY_HASH	64
+#define	MAX_IMAP_SECTS	8	/* the maps are kept in memory */
+#define	MAX_SMAP_SECTS	128	/* 256MB */
+#define	NR_JNL_BATCH	127	/* sectors in one journal transaction */
+#define	NR_HASH_TREES	8	/* files whose hash trees are kept */
+#define	HT_MAX_LEAVES	256	/* leaves of a hash tree */
+#define	HT_LEAF_SECTS	8	/* sectors of a leaf, at least */
+#define	NR_CK_PENDING	32	/* checksums to be refreshed */
 
 
 /* INODE::i_mode (octal, lower 12 bits reserved) */
@@ -67,31 +67,84 @@ struct super_block {
  */
 #define MD5_HASH_LEN		32   /* 32 hex chars */
 #define MD5_STR_BUF_LEN	33   /* 32 chars + NUL */
+#define	HT_DIGEST_LEN		16   /* a node of a hash tree */
+
+/**
+ * @struct hash_tree
+ * @brief  The hash tree of the data of a file, kept in memory so that only
+ *         what has changed is hashed again. md5_checksum is made from its
+ *         root. See fs/misc.c.
+ */
+struct hash_tree {
+	int	t_dev;
+	int	t_num;		/**< I-node nr, 0 if the slot is free */
+	int	t_size;		/**< File size when it was last hashed */
+	int	t_leaf_sects;	/**< Sectors per leaf */
+	u32	t_used;		/**< When it was last hashed, for the LRU */
+	u8	t_dirty[2 * HT_MAX_LEAVES / 8];	/**< Nodes to hash again */
+	u8	t_node[2 * HT_MAX_LEAVES][HT_DIGEST_LEN]; /**< 1 is the root,
+							   *   the leaves
+							   *   follow
+							   *   HT_MAX_LEAVES */
+};
+
+/**
+ * @struct extent
+ * @brief  A run of contiguous sectors of a file.
+ */
+struct extent {
+	u32	e_start;	/**< The first sector */
+	u32	e_nr;		/**< How many sectors, 0 if the slot is unused */
+};
+
+/**
+ * @def   NR_DIRECT_EXTENTS
+ * @brief Extents kept in the i-node itself.
+ *
+ * The rest (EXTENTS_PER_SECT of them at most) are kept in the sector
+ * pointed by \c i_ext_blk.
+ */
+#define	NR_DIRECT_EXTENTS	2
+#define	EXTENTS_PER_SECT	(SECTOR_SIZE / sizeof(struct extent))
+#define	NR_FILE_EXTENTS		(NR_DIRECT_EXTENTS + EXTENTS_PER_SECT)
 
 /**
  * @struct inode
  * @brief  i-node
  *
- * The \c start_sect and\c nr_sects locate the file in the device,
- * and the size show how many bytes is used.
- * If <tt> size < (nr_sects * SECTOR_SIZE) </tt>, the rest bytes
- * are wasted and reserved for later writing.
+ * The data of a file lives in up to NR_FILE_EXTENTS extents, which cover
+ * the file one after another. The 1st one is (\c start_sect, \c nr_sects),
+ * the 2nd (\c i_ext_start, \c i_ext_nr), and the others are in the sector
+ * \c i_ext_blk. Sectors are allocated as the file grows. The size shows how
+ * many bytes are used.
+ *
+ * For special files \c start_sect holds the device nr.
  *
  * \b NOTE: Remember to change INODE_SIZE if the members are changed
  */
 struct inode {
 	u32	i_mode;		/**< Accsess mode */
 	u32	i_size;		/**< File size */
-	u32	i_start_sect;	/**< The first sector of the data */
-	u32	i_nr_sects;	/**< How many sectors the file occupies */
+	u32	i_start_sect;	/**< The first sector of the 1st extent */
+	u32	i_nr_sects;	/**< How many sectors the 1st extent has */
 	char	md5_checksum[MD5_HASH_LEN];	/**< MD5校验和（32字符十六进制，不含'\0'） */
 	// u32	checksum_key;	/**< 用于计算MD5的key */
-	u8	_unused[16];	/**< Stuff for alignment，确保磁盘布局64字节 */
+	u32	i_ext_start;	/**< The 2nd extent */
+	u32	i_ext_nr;
+	u32	i_ext_blk;	/**< Sector of the other extents, 0 if none */
+	u32	i_dir_idx;	/**< Directories: the name index, 0 if none */
 
 	/* the following items are only present in memory */
 	int	i_dev;
 	int	i_cnt;		/**< How many procs share this inode  */
 	int	i_num;		/**< inode nr.  */
+	int	i_dirty;	/**< Changed since last written back */
+	u32	i_gen;		/**< Bumped whenever the data changes */
+	u32	i_ck_gen;	/**< The i_gen at which the data was found to
+				 *   match md5_checksum, 0 if never */
+	struct inode * i_hnext;	/**< Next in the hash chain */
+	struct inode * i_prev;	/**< LRU list of unreferenced inodes */
+	struct inode * i_next;
 };
 
 /**
@@ -101,7 +154,8 @@ struct inode {
  * Note that this is the size of the struct in the device, \b NOT in memory.
  * The size in memory is larger because of some more members.
  * 原来是32字节，现在扩展为：
- * 16(基础字段) + 32(MD5) + 4(key) + 12(padding) = 64字节
+ * 16(基础字段) + 32(MD5) + 16(i_ext_start, i_ext_nr, i_ext_blk,
+ * i_dir_idx) = 64字节
  */
 #define	INODE_SIZE	64
 
@@ -130,6 +184,43 @@ struct dir_entry {
  */
 #define	DIR_ENTRY_SIZE	sizeof(struct dir_entry)
 
+/**
+ * @struct dir_index
+ * @brief  Header of the name index of a directory.
+ *
+ * The index is a hash table of u32 buckets in the sectors right after this
+ * header, all allocated as one run. A bucket holds the slot nr of an entry
+ * plus one, 0 if it was never used, or DIR_IDX_TOMB if its name was removed.
+ * The entries themselves stay where they were so directories can still be
+ * read as arrays of dir_entry.
+ */
+struct dir_index {
+	u32	di_magic;	/**< DIR_IDX_MAGIC */
+	u32	di_nr_sects;	/**< Including this header */
+	u32	di_used;	/**< Buckets holding a slot */
+	u32	di_tomb;	/**< Buckets of removed names */
+	u32	di_free;	/**< No free slot in the dir below this one */
+};
+
+#define	DIR_IDX_MAGIC		0x58444944	/* "DIDX" */
+#define	DIR_IDX_TOMB		0xFFFFFFFF
+#define	DIR_IDX_MIN_SECTS	2
+#define	BUCKETS_PER_SECT	(SECTOR_SIZE / sizeof(u32))
+#define	ENTRIES_PER_SECT	(SECTOR_SIZE / DIR_ENTRY_SIZE)
+
+/**
+ * @struct dentry
+ * @brief  A cached (directory, name) -> inode nr lookup.
+ * @see    fs/dcache.c
+ */
+struct dentry {
+	int		d_dev;		/**< NO_DEV if the slot is free */
+	int		d_dir;		/**< I-node nr of the directory */
+	int		d_inode_nr;	/**< INVALID_INODE: no such file */
+	char		d_name[MAX_FILENAME_LEN]; /**< Zero padded */
+	struct dentry *	d_hnext;	/**< Next in the hash chain */
+};
+
 /**
  * @struct file_desc
  * @brief  File Descriptor
@@ -139,25 +230,100 @@ struct file_desc {
 	int		fd_pos;		/**< Current position for R/W. */
 	int		fd_cnt;		/**< How many procs share this desc */
 	struct inode*	fd_inode;	/**< Ptr to the i-node */
+	int		fd_ra_pos;	/**< Where a sequential read goes on */
+	int		fd_ra_win;	/**< Read-ahead window in sectors,
+					 *   0 if the reads are not sequential */
+};
+
+
+/**
+ * @struct buf
+ * @brief  A sector in the buffer cache.
+ * @see    fs/cache.c
+ */
+struct buf {
+	int		b_dev;		/**< NO_DEV if the buffer is free */
+	int		b_nr;		/**< Sector nr. */
+	int		b_dirty;	/**< Modified since read from the disk */
+	int		b_meta;		/**< Dirty metadata: goes through the
+					 *   journal */
+	u8 *		b_data;		/**< SECTOR_SIZE bytes in bcachebuf */
+	struct buf *	b_hnext;	/**< Next in the hash chain */
+	struct buf *	b_prev;		/**< LRU list */
+	struct buf *	b_next;
 };
 
 
+/**
+ * @struct journal_header
+ * @brief  The 1st sector of the journal.
+ *
+ * The header is followed by one transaction: a descriptor sector, which
+ * lists the home sector nr of each journaled sector, and the sectors
+ * themselves. The transaction counts once the header says so (\c j_nr != 0),
+ * and the header is cleared again when all the sectors are home.
+ */
+struct journal_header {
+	u32	j_magic;	/**< JOURNAL_MAGIC */
+	u32	j_seq;		/**< Transaction nr */
+	u32	j_nr;		/**< Sectors in the transaction, 0 if none */
+	u32	j_sum;		/**< Checksum of the descriptor and the sectors */
+};
+
+#define	JOURNAL_MAGIC	0x4C4E524A	/* "JRNL" */
+
+/**
+ * @struct fs_req
+ * @brief  A READ/WRITE of a regular file, kept while it is parked.
+ *
+ * The data of a READ/WRITE goes to/from the disk through iobuf, one transfer
+ * at a time. Instead of waiting for the driver, FS parks the request here and
+ * goes on serving others; when the driver replies, do_rdwt() picks the
+ * request up where it stopped.
+ */
+struct fs_req {
+	int		r_state;	/**< RQ_FREE, RQ_RUN, RQ_WAIT_IO, etc */
+	int		r_type;		/**< READ or WRITE */
+	int		r_src;		/**< Caller proc nr */
+	struct proc *	r_caller;	/**< Whose filp[] (the group leader) */
+	struct file_desc * r_pfd;
+	struct inode *	r_pin;
+	struct iovec	r_iov[IOV_MAX];	/**< Caller's buffers */
+	int		r_nr_iov;
+	int		r_seg;		/**< Which buffer it goes on in */
+	int		r_seg_off;	/**< Where in that buffer */
+	int		r_at;		/**< pread()/pwrite(): fd_pos stays */
+	int		r_pos;		/**< Where in the file it goes on */
+	int		r_done;		/**< Bytes r/w so far */
+	int		r_left;		/**< Bytes still to r/w */
+	int		r_parked;	/**< The reply is sent by do_rdwt() */
+	int		r_dead;		/**< The caller has exited */
+
+	/* the transfer through iobuf */
+	int		r_sect;
+	int		r_chunk;	/**< Sectors the caller asked for */
+	int		r_ra;		/**< Sectors read ahead */
+	int		r_off;		/**< Offset in the 1st sector */
+	int		r_bytes;
+
+	struct fs_req *	r_next;		/**< Next one waiting for iobuf */
+};
+
+#define	RQ_FREE		0
+#define	RQ_RUN		1	/* being served */
+#define	RQ_WAIT_IO	2	/* waiting for iobuf */
+#define	RQ_IO		3	/* the transfer is on the way */
+#define	RQ_IO_DONE	4	/* the driver has replied */
+
 /**
  * Since all invocations of `rw_sector()' in FS look similar (most of the
  * params are the same), we use this macro to make code more readable.
+ *
+ * Both go through the buffer cache: RD_SECT() copies the sector into fsbuf
+ * and WR_SECT() copies the first sector of fsbuf into the cache.
  */
-#define RD_SECT(dev,sect_nr) rw_sector(DEV_READ, \
-				       dev,				\
-				       (sect_nr) * SECTOR_SIZE,		\
-				       SECTOR_SIZE, /* read one sector */ \
-				       TASK_FS,				\
-				       fsbuf);
-#define WR_SECT(dev,sect_nr) rw_sector(DEV_WRITE, \
-				       dev,				\
-				       (sect_nr) * SECTOR_SIZE,		\
-				       SECTOR_SIZE, /* write one sector */ \
-				       TASK_FS,				\
-				       fsbuf);
+#define RD_SECT(dev,sect_nr) bread(dev, sect_nr);
+#define WR_SECT(dev,sect_nr) bwrite(dev, sect_nr);
 
 	
 #endif /* _ORANGES_FS_H_ */
@@ -45,6 +45,8 @@ EXTERN	MESSAGE			mm_msg;
 extern	u8 *			mmbuf;
 extern	const int		MMBUF_SIZE;
 EXTERN	int			memory_size;
+EXTERN	struct mem_region	mem_map[NR_MEM_REGIONS];
+EXTERN	int			nr_mem_regions;
 
 /* FS */
 EXTERN	struct file_desc	f_desc_table[NR_FILE_DESC];
@@ -52,6 +54,16 @@ EXTERN	struct inode		inode_table[NR_INODE];
 EXTERN	struct super_block	super_block[NR_SUPER_BLOCK];
 extern	u8 *			fsbuf;
 extern	const int		FSBUF_SIZE;
+extern	u8 *			bcachebuf;
+extern	const int		BCACHEBUF_SIZE;
+extern	u8 *			fsmapbuf;
+extern	const int		FSMAPBUF_SIZE;
+extern	u8 *			jnlbuf;
+extern	const int		JNLBUF_SIZE;
+extern	u8 *			iobuf;
+extern	const int		IOBUF_SIZE;
+extern	u8 *			htbuf;
+extern	const int		HTBUF_SIZE;
 EXTERN	MESSAGE			fs_msg;
 EXTERN	struct proc *		pcaller;
 EXTERN	struct inode *		root_inode;
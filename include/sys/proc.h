@@ -71,7 +71,14 @@ struct proc {
 	struct file_desc * filp[NR_FILES];
 	/* Stack bounds for TASK/NATIVE processes (linear addresses) */
 	u32 stack_low;   /**< low bound of stack (linear addr) */
-	u32 stack_high;  /**< high bound of stack (linear addr) */};
+	u32 stack_high;  /**< high bound of stack (linear addr) */
+
+	int p_tgid;      /**
+			  * thread group id, i.e. pid of the group leader.
+			  * a thread shares the memory and the filp[] of its
+			  * leader, for others p_tgid is the proc's own pid.
+			  */
+};
 
 struct task {
 	task_f	initial_eip;
@@ -82,24 +89,48 @@ struct task {
 #define proc2pid(x) (x - proc_table)
 
 /* Number of tasks & processes */
-#define NR_TASKS		6
+#define NR_TASKS		7
 #define NR_PROCS		32
 #define NR_NATIVE_PROCS		4
 #define FIRST_PROC		proc_table[0]
 #define LAST_PROC		proc_table[NR_TASKS + NR_PROCS - 1]
 
 /**
- * All forked proc will use memory above PROCS_BASE.
- *
- * @attention make sure PROCS_BASE is higher than any buffers, such as
- *            fsbuf, mmbuf, etc
- * @see global.c
- * @see global.h
+ * A forked proc gets PROC_IMAGE_SIZE_DEFAULT bytes wherever alloc_mem()
+ * finds a hole in usable RAM.
+ * @see kernel/memory.c
  */
-#define	PROCS_BASE		0xA00000 /* 10 MB */
 #define	PROC_IMAGE_SIZE_DEFAULT	0x100000 /*  1 MB */
 #define	PROC_ORIGIN_STACK	0x400    /*  1 KB */
 
+/**
+ * Shared memory segments are attached inside this window of a proc image,
+ * between the program and its stack.
+ * @see mm/shm.c
+ */
+#define	SHM_WINDOW_BASE		0x80000  /* 512 KB */
+#define	SHM_WINDOW_SIZE		0x40000  /* 256 KB */
+#define	NR_SHM			16
+#define	NR_SHM_ATTACH		(NR_PROCS * 2)
+
+/**
+ * @struct mem_region
+ * @brief  A block of physical memory accounted by MM.
+ *
+ * Every byte handed out, whether it is a buffer of some task or the image
+ * of a forked proc, is recorded in mem_map[], and so is every address
+ * below memory_size which the E820 map does not report as usable RAM.
+ * Bytes not covered by any region are free.
+ */
+struct mem_region {
+	int	base;		/**< physical (== linear) address */
+	int	size;		/**< in bytes */
+	int	owner;		/**< pid, MEM_OWNER_KERNEL or MEM_OWNER_NONE */
+	char	name[16];	/**< what the block is used for */
+};
+
+#define	NR_MEM_REGIONS		(NR_PROCS + 32) /* procs, buffers & E820 holes */
+
 /* stacks of tasks */
 #define	STACK_SIZE_DEFAULT	0x4000 /* 16 KB */
 #define STACK_SIZE_TTY		STACK_SIZE_DEFAULT
@@ -108,6 +139,7 @@ struct task {
 #define STACK_SIZE_FS		STACK_SIZE_DEFAULT
 #define STACK_SIZE_MM		STACK_SIZE_DEFAULT
 #define STACK_SIZE_LOG		STACK_SIZE_DEFAULT //新加
+#define STACK_SIZE_FLUSH	STACK_SIZE_DEFAULT
 #define STACK_SIZE_INIT		STACK_SIZE_DEFAULT
 #define STACK_SIZE_TESTA	STACK_SIZE_DEFAULT
 #define STACK_SIZE_TESTB	STACK_SIZE_DEFAULT
@@ -119,6 +151,7 @@ struct task {
 				STACK_SIZE_FS + \
 				STACK_SIZE_MM + \
 				STACK_SIZE_LOG + \
+				STACK_SIZE_FLUSH + \
 				STACK_SIZE_INIT + \
 				STACK_SIZE_TESTA + \
 				STACK_SIZE_TESTB + \
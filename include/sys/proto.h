@@ -17,6 +17,7 @@ PUBLIC void	enable_int();
 PUBLIC void	port_read(u16 port, void* buf, int n);
 PUBLIC void	port_write(u16 port, void* buf, int n);
 PUBLIC void	glitter(int row, int col);
+PUBLIC void	reload_cr3();
 
 /* string.asm */
 PUBLIC char*	strcpy(char* dst, const char* src);
@@ -34,12 +35,21 @@ PUBLIC void	delay(int time);
 PUBLIC void	disp_int(int input);
 PUBLIC char *	itoa(char * str, int num);
 
+/* memory.c */
+PUBLIC void	init_mem();
+PUBLIC void	reserve_mem(int base, int size, int owner, const char * name);
+PUBLIC int	carve_mem(int size, int owner, const char * name);
+PUBLIC void	release_mem(int owner);
+PUBLIC void	release_mem_at(int base);
+PUBLIC u32	la2pa(u32 la);
+PUBLIC void	map_page(u32 la, u32 pa);
+PUBLIC int	page_dirty(u32 la);
+
 /* kernel.asm */
 PUBLIC void restart();
 
 /* main.c */
 PUBLIC void Init();
-PUBLIC int  get_ticks();
 PUBLIC void TestA();
 PUBLIC void TestB();
 PUBLIC void TestC();
@@ -81,26 +91,116 @@ PUBLIC int			rw_sector(int io_type, int dev, u64 pos,
 PUBLIC struct inode *		get_inode(int dev, int num);
 PUBLIC void			put_inode(struct inode * pinode);
 PUBLIC void			sync_inode(struct inode * p);
+PUBLIC void			sync_inodes();
 PUBLIC struct super_block *	get_super_block(int dev);
 
+/* fs/cache.c */
+PUBLIC void		init_bcache();
+PUBLIC void		bread(int dev, int nr);
+PUBLIC void		bwrite(int dev, int nr);
+PUBLIC void		mark_meta_dirty(struct buf * bp);
+PUBLIC struct buf *	get_buf(int dev, int nr, int read);
+PUBLIC void		write_buf(struct buf * bp);
+PUBLIC struct buf *	peek_buf(int dev, int nr);
+PUBLIC void		fill_blocks(int dev, int nr, int cnt, u8 * data);
+PUBLIC int		sync_blocks(int dev, int nr, int cnt);
+PUBLIC int		dirty_meta_bufs(struct buf ** list, int max);
+PUBLIC void		inval_blocks(int dev, int nr, int cnt);
+PUBLIC void		bcache_stat(int * hits, int * misses, int * writes);
+
+/* fs/journal.c */
+PUBLIC void		replay_journal(int dev);
+PUBLIC void		init_journal(int dev);
+PUBLIC void		journal_commit();
+
+/* fs/dcache.c */
+PUBLIC void		init_dcache();
+PUBLIC int		dcache_lookup(int dev, int dir, const char * name);
+PUBLIC void		dcache_enter(int dev, int dir, const char * name,
+				     int inode_nr);
+PUBLIC void		dcache_purge(int dev, int dir);
+
+/* fs/bitmap.c */
+PUBLIC void		load_bitmaps(int dev);
+PUBLIC void		sync_bitmaps();
+PUBLIC int		alloc_imap_bit(int dev);
+PUBLIC void		free_imap_bit(int dev, int inode_nr);
+PUBLIC int		find_free_run(int dev, int n);
+PUBLIC void		set_smap_bits(int dev, int bit, int n);
+PUBLIC void		free_smap_bits(int dev, int bit, int n);
+PUBLIC int		alloc_sects(int dev, int * nr);
+PUBLIC int		extend_sects(int dev, int sect, int nr);
+PUBLIC void		free_sects(int dev, int sect, int nr);
+
+/* fs/dir.c */
+PUBLIC int		dir_lookup(struct inode * dir, const char * name);
+PUBLIC int		dir_add(struct inode * dir, const char * name,
+				int inode_nr);
+PUBLIC int		dir_remove(struct inode * dir, const char * name);
+PUBLIC int		dir_is_empty(struct inode * dir);
+PUBLIC void		dir_free_index(struct inode * dir);
+PUBLIC int		dir_next(struct inode * dir, int * slot, char * name);
+
+/* fs/extent.c */
+PUBLIC int		bmap(struct inode * pin, int lsect, int * run);
+PUBLIC int		file_sects(struct inode * pin);
+PUBLIC int		grow_file(struct inode * pin, int nr_sects);
+PUBLIC void		shrink_file(struct inode * pin, int nr_sects);
+
 /* fs/open.c */
 PUBLIC int		do_open();
 PUBLIC int		do_close();
 PUBLIC int		do_lseek();
 PUBLIC int		do_truncate();
+PUBLIC int		do_mkdir();
+
+/* fs/sync.c */
+PUBLIC void		task_flush();
+PUBLIC void		sync_all();
+PUBLIC int		do_sync();
+PUBLIC int		do_fsync();
 
 /* fs/read_write.c */
 PUBLIC int		do_rdwt();
+PUBLIC void		rdwt_resume(struct fs_req * r);
+PUBLIC int		do_copy_range();
+PUBLIC void		cache_rw(struct inode * pin, int pos, int pid, char * buf,
+				 int len, int write);
+
+/* fs/mmap.c */
+PUBLIC int		do_fmap_open();
+PUBLIC int		do_fmap_write();
+PUBLIC int		do_fmap_close();
+
+/* fs/park.c */
+PUBLIC struct fs_req *	get_req(int src);
+PUBLIC int		parked_on(struct inode * pin);
+PUBLIC int		get_iobuf(struct fs_req * r);
+PUBLIC void		put_iobuf(struct fs_req * r);
+PUBLIC void		start_io(struct fs_req * r, int io_type, int dev,
+				 int sect, int nr_sects);
+PUBLIC void		wait_io();
+PUBLIC int		io_reply(MESSAGE * m);
+PUBLIC void		run_parked();
+PUBLIC void		defer_msg();
+PUBLIC void		wake_deferred();
+PUBLIC int		next_deferred(MESSAGE * m);
+PUBLIC int		cancel_parked(int pid);
 
 /* fs/link.c */
 PUBLIC int		do_unlink();
 
 /* fs/misc.c */
 PUBLIC int		do_stat();
+PUBLIC int		do_fstat();
+PUBLIC int		do_readdir();
 PUBLIC int		strip_path(char * filename, const char * pathname,
 				   struct inode** ppinode);
 PUBLIC int		search_file(char * path);
 // PUBLIC int		do_calc_checksum();
+PUBLIC void		ht_drop(struct inode * pin);
+PUBLIC void		ht_dirty(struct inode * pin, int pos, int len);
+PUBLIC void		ck_forget(struct inode * pin);
 PUBLIC int		do_verify_checksum();
 PUBLIC int		do_refresh_checksums();
 
@@ -120,6 +220,22 @@ PUBLIC void		do_exit(int status);
 PUBLIC int		do_kill();
 PUBLIC void		do_wait();
 
+/* mm/thread.c */
+PUBLIC int		do_thread_create();
+PUBLIC void		do_futex_wait();
+PUBLIC int		do_futex_wake();
+PUBLIC void		futex_cancel(int pid);
+PUBLIC int		thread_group_size(int tgid);
+
+/* mm/shm.c */
+PUBLIC int		do_shmget();
+PUBLIC int		do_shmat();
+PUBLIC int		do_shmdt();
+PUBLIC int		do_mmap();
+PUBLIC int		do_msync();
+PUBLIC void		shm_fork(int parent, int child);
+PUBLIC void		shm_exit(int pid);
+
 /* mm/exec.c */
 PUBLIC int		do_exec();
 
@@ -140,6 +256,7 @@ PUBLIC	void	reset_msg(MESSAGE* p);
 PUBLIC	void	dump_msg(const char * title, MESSAGE* m);
 PUBLIC	void	dump_proc(struct proc * p);
 PUBLIC	int	send_recv(int function, int src_dest, MESSAGE* msg);
+PUBLIC	void	ipc_cancel(struct proc* p);
 PUBLIC void	inform_int(int task_nr);
 PUBLIC int	mlfq_should_preempt_current();
 
@@ -161,6 +278,9 @@ PUBLIC u32  generate_checksum_key();
 /* proc.c */
 PUBLIC	int	sys_sendrec(int function, int src_dest, MESSAGE* m, struct proc* p);
 PUBLIC	int	sys_printx(int _unused1, int _unused2, char* s, struct proc * p_proc);
+/* memory.c */
+PUBLIC	int	sys_flush_tlb(int _unused1, int _unused2, int _unused3,
+			      struct proc * p_proc);
 
 /* syscall.asm */
 PUBLIC  void    sys_call();             /* int_handler */
@@ -168,6 +288,7 @@ PUBLIC  void    sys_call();             /* int_handler */
 /* 系统调用 - 用户级 */
 PUBLIC	int	sendrec(int function, int src_dest, MESSAGE* p_msg);
 PUBLIC	int	printx(char* str);
+PUBLIC	void	flush_tlb();
 
 // canary
 PUBLIC int put_canary();
@@ -61,10 +61,27 @@ typedef struct {
 	} u;
 } MESSAGE;
 
+/**
+ * @struct mem_range
+ * @brief  An Address Range Descriptor Structure returned by BIOS INT 15h,
+ *         E820h. The loader copies them into the boot params.
+ */
+struct mem_range {
+	u32	base_low;
+	u32	base_high;
+	u32	len_low;
+	u32	len_high;
+	u32	type;		/* MEM_RANGE_USABLE or something reserved */
+};
+
+#define	MEM_RANGE_USABLE	1
+
 /* i have no idea of where to put this struct, so i put it here */
 struct boot_params {
 	int		mem_size;	/* memory size */
 	unsigned char *	kernel_file;	/* addr of kernel file */
+	int		nr_mem_ranges;	/* entries in mem_ranges[] */
+	struct mem_range * mem_ranges;	/* the E820 memory map */
 };
 
 
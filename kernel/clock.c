@@ -40,6 +40,9 @@ PUBLIC void clock_handler(int irq)
 	if (key_pressed)
 		inform_int(TASK_TTY);
 
+	if (ticks % FLUSH_INTERVAL_TICKS == 0)
+		inform_int(TASK_FLUSH);
+
 	if (k_reenter != 0)
 	{
 		return;
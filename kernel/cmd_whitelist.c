@@ -9,9 +9,12 @@ const char* g_syscmd_whitelist[] = {
 	"ls",
 	"kill",
 	"touch",
+	"mkdir",
 	"edit",
 	"rm",
 	"ps",
+	"free",
+	"hashbench",
 	"clear",
 	"cat",
 	"ret2text",
@@ -32,7 +32,8 @@ PUBLIC	struct task	task_table[NR_TASKS] = {
 	{task_hd,       STACK_SIZE_HD,    "HD"        },
 	{task_fs,       STACK_SIZE_FS,    "FS"        },
 	{task_mm,       STACK_SIZE_MM,    "MM"        },
-	{task_log,      STACK_SIZE_LOG,   "LOG"		  }   /* 新增 */
+	{task_log,      STACK_SIZE_LOG,   "LOG"		  },  /* 新增 */
+	{task_flush,    STACK_SIZE_FLUSH, "FLUSH"     }
 };
 
 PUBLIC	struct task	user_proc_table[NR_NATIVE_PROCS] = {
@@ -51,7 +52,8 @@ PUBLIC	CONSOLE		console_table[NR_CONSOLES];
 PUBLIC	irq_handler	irq_table[NR_IRQ];
 
 PUBLIC	system_call	sys_call_table[NR_SYS_CALL] = {sys_printx,
-						       sys_sendrec};
+						       sys_sendrec,
+						       sys_flush_tlb};
 
 /* FS related below */
 /*****************************************************************************/
@@ -73,24 +75,67 @@ struct dev_drv_map dd_map[] = {
 };
 
 /**
- * 6MB~7MB: buffer for FS
+ * The buffers below are carved out of usable RAM by init_mem() before any
+ * task runs.
+ * @see kernel/memory.c
  */
-PUBLIC	u8 *		fsbuf		= (u8*)0x600000;
+
+/**
+ * buffer for FS
+ */
+PUBLIC	u8 *		fsbuf;
 PUBLIC	const int	FSBUF_SIZE	= 0x100000;
 
 
 /**
- * 7MB~8MB: buffer for MM
+ * sectors of the buffer cache (FS)
+ */
+PUBLIC	u8 *		bcachebuf;
+PUBLIC	const int	BCACHEBUF_SIZE	= NR_BUF * SECTOR_SIZE;
+
+
+/**
+ * inode-map and sector-map of the root device (FS)
+ */
+PUBLIC	u8 *		fsmapbuf;
+PUBLIC	const int	FSMAPBUF_SIZE	= (MAX_IMAP_SECTS + MAX_SMAP_SECTS) *
+					  SECTOR_SIZE;
+
+
+/**
+ * a journal transaction being written (FS)
+ */
+PUBLIC	u8 *		jnlbuf;
+PUBLIC	const int	JNLBUF_SIZE	= (NR_JNL_BATCH + 1) * SECTOR_SIZE;
+
+
+/**
+ * data of a READ/WRITE on the way to/from the disk (FS)
+ */
+PUBLIC	u8 *		iobuf;
+PUBLIC	const int	IOBUF_SIZE	= 0x100000;
+
+
+/**
+ * hash trees of files (FS)
+ */
+PUBLIC	u8 *		htbuf;
+PUBLIC	const int	HTBUF_SIZE	= NR_HASH_TREES *
+					  sizeof(struct hash_tree);
+
+
+/**
+ * buffer for MM
  */
-PUBLIC	u8 *		mmbuf		= (u8*)0x700000;
+PUBLIC	u8 *		mmbuf;
 PUBLIC	const int	MMBUF_SIZE	= 0x100000;
 
 
 /**
- * 8MB~10MB: buffer for log (debug)
+ * buffer for log (debug)
  */
-PUBLIC	char *		logbuf		= (char*)0x800000;
+PUBLIC	char *		logbuf;
 PUBLIC	const int	LOGBUF_SIZE	= 0x100000;
-PUBLIC	char *		logdiskbuf	= (char*)0x900000;
+PUBLIC	char *		logdiskbuf;
 PUBLIC	const int	LOGDISKBUF_SIZE	= 0x100000;
 
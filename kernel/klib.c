@@ -44,6 +44,9 @@ PUBLIC void get_boot_params(struct boot_params * pbp)
 
 	pbp->mem_size = p[BI_MEM_SIZE];
 	pbp->kernel_file = (unsigned char *)(p[BI_KERNEL_FILE]);
+	pbp->nr_mem_ranges = p[BI_NR_MEM_RANGES];
+	pbp->mem_ranges = (struct mem_range *)&p[BI_MEM_RANGES];
+	assert(pbp->nr_mem_ranges <= MAX_MEM_RANGES);
 
 	/**
 	 * the kernel file should be a ELF executable,
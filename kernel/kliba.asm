@@ -25,6 +25,7 @@ global	disable_int
 global	port_read
 global	port_write
 global	glitter
+global	reload_cr3
 
 
 
@@ -239,6 +240,15 @@ enable_int:
 	sti
 	ret
 
+; ========================================================================
+;		   void reload_cr3();
+; ========================================================================
+; flush the whole TLB
+reload_cr3:
+	mov	eax, cr3
+	mov	cr3, eax
+	ret
+
 ; ========================================================================
 ;                  void glitter(int row, int col);
 ; ========================================================================
@@ -316,6 +316,15 @@ static const char* mm_type_name(int msgtype)
     case EXEC: return "EXEC";
     case WAIT: return "WAIT";
     case KILL: return "KILL";
+    case MEMSTAT: return "MEMSTAT";
+    case THREAD_CREATE: return "THREAD_CREATE";
+    case FUTEX_WAIT: return "FUTEX_WAIT";
+    case FUTEX_WAKE: return "FUTEX_WAKE";
+    case SHM_GET: return "SHM_GET";
+    case SHM_AT: return "SHM_AT";
+    case SHM_DT: return "SHM_DT";
+    case MMAP: return "MMAP";
+    case MSYNC: return "MSYNC";
     default:   return "UNKNOWN";
     }
 }
@@ -344,7 +353,16 @@ static const char* fs_type_name(int msgtype)
     case FORK:   return "FORK";
     case EXIT:   return "EXIT";
     case STAT:   return "STAT";
+    case FSTAT:  return "FSTAT";
     case TRUNCATE: return "TRUNCATE";
+    case MKDIR:  return "MKDIR";
+    case SYNC:   return "SYNC";
+    case FSYNC:  return "FSYNC";
+    case COPY_RANGE: return "COPY_RANGE";
+    case READDIR:    return "READDIR";
+    case FMAP_OPEN:  return "FMAP_OPEN";
+    case FMAP_WRITE: return "FMAP_WRITE";
+    case FMAP_CLOSE: return "FMAP_CLOSE";
     // case CALC_CHECKSUM: return "CALC_CHECKSUM";
     case REFRESH_CHECKSUMS: return "REFRESH_CHECKSUMS";
     case VERIFY_CHECKSUM: return "VERIFY_CHECKSUM";
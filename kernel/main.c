@@ -42,6 +42,8 @@ PUBLIC int kernel_main()
 
 	char *stk = task_stack + STACK_SIZE_TOTAL;
 
+	init_mem();
+
 #define TASK_LOG_INDEX 5
 
 	// 系统任务和NATIVE用户进程
@@ -134,6 +136,7 @@ PUBLIC int kernel_main()
 		p->queue_level = 0;
 
 		p->p_flags = 0;
+		p->p_tgid = i;
 		p->p_msg = 0;
 		p->p_recvfrom = NO_TASK;
 		p->p_sendto = NO_TASK;
@@ -162,18 +165,6 @@ PUBLIC int kernel_main()
 	}
 }
 
-/*****************************************************************************
- *                                get_ticks
- *****************************************************************************/
-PUBLIC int get_ticks()
-{
-	MESSAGE msg;
-	reset_msg(&msg);
-	msg.type = GET_TICKS;
-	send_recv(BOTH, TASK_SYS, &msg);
-	return msg.RETVAL;
-}
-
 /**
  * @struct posix_tar_header
  * Borrowed from GNU `tar'
@@ -256,6 +247,11 @@ void untar(const char *filename)
 		}
 		printf("    %s\n", phdr->name);
 
+		/* take all the sectors at once, so that they are in one run
+		 * if there is one: hdldr reads kernel.bin from i_start_sect
+		 * on, it doesn't follow the extents */
+		ftruncate(fdout, f_len);
+
 		while (bytes_left)
 		{
 			int iobytes = min(chunk, bytes_left);
@@ -405,11 +401,12 @@ void Init()
 	untar("/cmd.tar");
 
 	//  刷新所有可执行文件的校验和（每次启动都执行，与untar解耦）
+	//  只是登记，真正的计算在首次执行时或由 TASK FLUSH 在后台完成
 	printf("[refreshing checksums...\n");
 	int refreshed = refresh_checksums();
 	if (refreshed >= 0)
 	{
-		printf(" done, %d file(s) refreshed]\n", refreshed);
+		printf(" %d file(s) to be refreshed in background]\n", refreshed);
 	}
 	else
 	{
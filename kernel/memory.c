@@ -0,0 +1,368 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   memory.c
+ * @brief  Physical memory map.
+ *
+ * The loader hands over the BIOS E820 memory map. init_mem() turns it into
+ * mem_map[], reserves what the kernel and the loader have already taken,
+ * and carves the buffers of the tasks out of usable RAM. After that, MM is
+ * the only one who changes mem_map[] (through alloc_mem() and free_mem()).
+ *
+ * map_page() lets MM back a page of a proc image with some other frame,
+ * which is how shared memory segments and mapped files are attached.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+#define	PTE_DIRTY	0x40	/* set by the CPU when the page is written */
+
+PRIVATE int  usable_end(struct boot_params * bp, u32 addr);
+PRIVATE u32  next_usable(struct boot_params * bp, u32 addr);
+PRIVATE int  find_free_mem(int size);
+
+/*****************************************************************************
+ *                                init_mem
+ *****************************************************************************/
+/**
+ * <Ring 0> Build mem_map[] from the boot params, then place the buffers of
+ * FS, MM and the logs. Must be called before any task runs.
+ * 
+ *****************************************************************************/
+PUBLIC void init_mem()
+{
+	struct boot_params bp;
+	get_boot_params(&bp);
+
+	/* the loader has mapped [0, mem_size) one-to-one */
+	memory_size = bp.mem_size;
+	nr_mem_regions = 0;
+
+	/* BIOS, the loader, the kernel image and the kernel file */
+	unsigned int k_base;
+	unsigned int k_limit;
+	int ret = get_kernel_map(&k_base, &k_limit);
+	assert(ret == 0);
+	assert(k_base + k_limit < PAGE_DIR_BASE);
+	reserve_mem(0, PAGE_DIR_BASE, MEM_OWNER_KERNEL, "kernel");
+
+	/* one page table for every 4MB, see SetupPaging in the loader */
+	int nr_pgtbl = (memory_size + 0x400000 - 1) / 0x400000;
+	int pgtbl_top = PAGE_TBL_BASE + nr_pgtbl * 4096;
+	reserve_mem(PAGE_DIR_BASE, pgtbl_top - PAGE_DIR_BASE,
+		    MEM_OWNER_KERNEL, "pgtbl");
+
+	/**
+	 * Whatever the E820 map doesn't report as usable (ACPI tables, the
+	 * ISA hole, etc) is kept away from everybody.
+	 */
+	u32 addr = pgtbl_top;
+	while (addr < memory_size) {
+		int end = usable_end(&bp, addr);
+		if (end != -1) {
+			addr = end;
+			continue;
+		}
+		u32 next = next_usable(&bp, addr);
+		reserve_mem(addr, next - addr, MEM_OWNER_NONE, "reserved");
+		addr = next;
+	}
+
+	fsbuf      = (u8*)carve_mem(FSBUF_SIZE, TASK_FS, "fsbuf");
+	bcachebuf  = (u8*)carve_mem(BCACHEBUF_SIZE, TASK_FS, "bcache");
+	fsmapbuf   = (u8*)carve_mem(FSMAPBUF_SIZE, TASK_FS, "fsmap");
+	jnlbuf     = (u8*)carve_mem(JNLBUF_SIZE, TASK_FS, "journal");
+	iobuf      = (u8*)carve_mem(IOBUF_SIZE, TASK_FS, "iobuf");
+	htbuf      = (u8*)carve_mem(HTBUF_SIZE, TASK_FS, "hashtree");
+	mmbuf      = (u8*)carve_mem(MMBUF_SIZE, TASK_MM, "mmbuf");
+	logbuf     = (char*)carve_mem(LOGBUF_SIZE, TASK_LOG, "logbuf");
+	logdiskbuf = (char*)carve_mem(LOGDISKBUF_SIZE, TASK_FS, "logdiskbuf");
+	if ((int)fsbuf == -1 || (int)bcachebuf == -1 ||
+	    (int)fsmapbuf == -1 || (int)jnlbuf == -1 || (int)iobuf == -1 ||
+	    (int)htbuf == -1 || (int)mmbuf == -1 || (int)logbuf == -1 ||
+	    (int)logdiskbuf == -1)
+		panic("not enough memory for the buffers");
+}
+
+/*****************************************************************************
+ *                                usable_end
+ *****************************************************************************/
+/**
+ * If `addr' is inside some usable E820 range, return where the range ends
+ * (clipped to memory_size).
+ * 
+ * @param bp    Boot params.
+ * @param addr  Physical address.
+ * 
+ * @return  End of the range, or -1 if `addr' is not usable.
+ *****************************************************************************/
+PRIVATE int usable_end(struct boot_params * bp, u32 addr)
+{
+	int i;
+	for (i = 0; i < bp->nr_mem_ranges; i++) {
+		struct mem_range * r = &bp->mem_ranges[i];
+		if (r->type != MEM_RANGE_USABLE || r->base_high)
+			continue;
+
+		/* ranges crossing 4GB are clipped */
+		u32 end = r->base_low + r->len_low;
+		if (r->len_high || end < r->base_low)
+			end = ~0;
+
+		if (addr >= r->base_low && addr < end)
+			return end > memory_size ? memory_size : end;
+	}
+	return -1;
+}
+
+/*****************************************************************************
+ *                                next_usable
+ *****************************************************************************/
+/**
+ * Find the lowest usable E820 range above `addr'.
+ * 
+ * @param bp    Boot params.
+ * @param addr  Physical address.
+ * 
+ * @return  Base of that range, or memory_size if there is none.
+ *****************************************************************************/
+PRIVATE u32 next_usable(struct boot_params * bp, u32 addr)
+{
+	u32 next = memory_size;
+	int i;
+	for (i = 0; i < bp->nr_mem_ranges; i++) {
+		struct mem_range * r = &bp->mem_ranges[i];
+		if (r->type != MEM_RANGE_USABLE || r->base_high)
+			continue;
+		if (r->base_low > addr && r->base_low < next)
+			next = r->base_low;
+	}
+	return next;
+}
+
+/*****************************************************************************
+ *                                reserve_mem
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Record a region in mem_map[], keeping the map sorted by base.
+ * 
+ * @param base   Physical address of the region.
+ * @param size   How many bytes.
+ * @param owner  PID of the owner, or MEM_OWNER_xxx.
+ * @param name   What the region is used for.
+ *****************************************************************************/
+PUBLIC void reserve_mem(int base, int size, int owner, const char * name)
+{
+	if (nr_mem_regions >= NR_MEM_REGIONS)
+		panic("mem_map[] is full");
+
+	int i;
+	for (i = 0; i < nr_mem_regions; i++)
+		if (mem_map[i].base > base)
+			break;
+
+	/* no overlap with the neighbours */
+	assert(i == 0 ||
+	       mem_map[i - 1].base + mem_map[i - 1].size <= base);
+	assert(i == nr_mem_regions || base + size <= mem_map[i].base);
+
+	int j;
+	for (j = nr_mem_regions; j > i; j--)
+		mem_map[j] = mem_map[j - 1];
+	nr_mem_regions++;
+
+	struct mem_region * r = &mem_map[i];
+	r->base = base;
+	r->size = size;
+	r->owner = owner;
+	int len = strlen(name);
+	if (len >= sizeof(r->name))
+		len = sizeof(r->name) - 1;
+	memcpy(r->name, (void*)name, len);
+	r->name[len] = 0;
+}
+
+/*****************************************************************************
+ *                                find_free_mem
+ *****************************************************************************/
+/**
+ * First fit: find the lowest page-aligned hole between regions which is
+ * big enough.
+ * 
+ * @param size  How many bytes is needed.
+ * 
+ * @return  Base of the hole, or -1 if no hole is big enough.
+ *****************************************************************************/
+PRIVATE int find_free_mem(int size)
+{
+	int base = 0;
+	int i;
+	for (i = 0; i <= nr_mem_regions; i++) {
+		int top = (i == nr_mem_regions) ? memory_size : mem_map[i].base;
+		if (top - base >= size)
+			return base;
+		if (i < nr_mem_regions)
+			base = (mem_map[i].base + mem_map[i].size + 4095) & ~4095;
+	}
+	return -1;
+}
+
+/*****************************************************************************
+ *                                carve_mem
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Take `size' bytes from the lowest free place of usable RAM.
+ * 
+ * @param size   How many bytes is needed.
+ * @param owner  PID of the owner, or MEM_OWNER_KERNEL.
+ * @param name   What the memory is used for.
+ * 
+ * @return  Physical address of the memory, or -1 if RAM is exhausted.
+ *****************************************************************************/
+PUBLIC int carve_mem(int size, int owner, const char * name)
+{
+	int base = find_free_mem(size);
+	if (base != -1)
+		reserve_mem(base, size, owner, name);
+	return base;
+}
+
+/*****************************************************************************
+ *                                release_mem
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Drop every region owned by `owner' from mem_map[].
+ * 
+ * @param owner  Whose memory is to be released.
+ *****************************************************************************/
+PUBLIC void release_mem(int owner)
+{
+	int i = 0;
+	while (i < nr_mem_regions) {
+		if (mem_map[i].owner == owner) {
+			int j;
+			for (j = i; j < nr_mem_regions - 1; j++)
+				mem_map[j] = mem_map[j + 1];
+			nr_mem_regions--;
+		}
+		else {
+			i++;
+		}
+	}
+}
+
+/*****************************************************************************
+ *                                release_mem_at
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Drop the region which starts at `base' from mem_map[].
+ * 
+ * @param base  Physical address of the region.
+ *****************************************************************************/
+PUBLIC void release_mem_at(int base)
+{
+	int i;
+	for (i = 0; i < nr_mem_regions; i++) {
+		if (mem_map[i].base == base) {
+			for (; i < nr_mem_regions - 1; i++)
+				mem_map[i] = mem_map[i + 1];
+			nr_mem_regions--;
+			return;
+		}
+	}
+	assert(0);
+}
+
+/*****************************************************************************
+ *                                la2pa
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Translate a linear address through the page tables. All RAM
+ * is mapped one-to-one by the loader, except the pages remapped by
+ * map_page().
+ * 
+ * @param la  Linear address.
+ * 
+ * @return  Physical address.
+ *****************************************************************************/
+PUBLIC u32 la2pa(u32 la)
+{
+	u32 * pte = (u32*)PAGE_TBL_BASE + (la >> 12);
+	return (*pte & ~0xFFF) | (la & 0xFFF);
+}
+
+/*****************************************************************************
+ *                                map_page
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Let the page at linear address `la' be backed by the frame at
+ * `pa'. map_page(la, la) restores the one-to-one mapping.
+ * 
+ * @attention The TLB is not flushed here. Ring 1 callers should call
+ *            flush_tlb() once they are done with the page tables.
+ *
+ * @param la  Linear address of the page.
+ * @param pa  Physical address of the frame.
+ *****************************************************************************/
+PUBLIC void map_page(u32 la, u32 pa)
+{
+	assert((la & 0xFFF) == 0 && (pa & 0xFFF) == 0);
+	assert(la < memory_size && pa < memory_size);
+
+	u32 * pte = (u32*)PAGE_TBL_BASE + (la >> 12);
+	*pte = pa | (*pte & 0xFFF);
+}
+
+/*****************************************************************************
+ *                                page_dirty
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Whether a page has been written since the last call, which
+ * is told by the dirty bit of its page table entry.
+ * 
+ * @attention The bit is cleared. The caller must flush_tlb() before the
+ *            page is written again, or the CPU won't set it any more.
+ *
+ * @param la  Linear address of the page.
+ * 
+ * @return  Nonzero if it has been written.
+ *****************************************************************************/
+PUBLIC int page_dirty(u32 la)
+{
+	u32 * pte = (u32*)PAGE_TBL_BASE + (la >> 12);
+	int dirty = *pte & PTE_DIRTY;
+	*pte &= ~PTE_DIRTY;
+	return dirty;
+}
+
+/*****************************************************************************
+ *                                sys_flush_tlb
+ *****************************************************************************/
+/**
+ * <Ring 0> The flush_tlb() syscall. Tasks (ring 1) use it after changing the
+ * page tables since they can't touch CR3 themselves.
+ * 
+ * @param p_proc  Caller proc.
+ * 
+ * @return  Zero if success, -1 if the caller is not a task.
+ *****************************************************************************/
+PUBLIC int sys_flush_tlb(int _unused1, int _unused2, int _unused3,
+			 struct proc * p_proc)
+{
+	if (proc2pid(p_proc) >= NR_TASKS)
+		return -1;
+
+	reload_cr3();
+	return 0;
+}
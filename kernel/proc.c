@@ -371,6 +371,10 @@ PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m)
 		panic(">>DEADLOCK<< %s->%s", sender->name, p_dest->name);
 	}
 
+	/* dest is gone, e.g. a reply to a killed proc, see ipc_cancel() */
+	if (p_dest->p_flags & HANGING)
+		return 0;
+
 	if ((p_dest->p_flags & RECEIVING) && /* dest is waiting for the msg */
 	    (p_dest->p_recvfrom == proc2pid(sender) ||
 	     p_dest->p_recvfrom == ANY)) {
@@ -592,6 +596,44 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m)
 	return 0;
 }
 
+/*****************************************************************************
+ *                                ipc_cancel
+ *****************************************************************************/
+/**
+ * <Ring 1> Take a proc which is going away out of the IPC, wherever it is
+ * blocked: off the sending queue of its dest, or no longer waiting for a
+ * message. The proc becomes HANGING, and messages sent to it from now on
+ * are dropped, see msg_send().
+ * 
+ * @param p  The proc.
+ *****************************************************************************/
+PUBLIC void ipc_cancel(struct proc* p)
+{
+	disable_int();
+
+	if (p->p_flags & SENDING) {
+		struct proc* q = proc_table[p->p_sendto].q_sending;
+		struct proc* prev = 0;
+		while (q != p) {
+			assert(q);
+			prev = q;
+			q = q->next_sending;
+		}
+		if (prev)
+			prev->next_sending = p->next_sending;
+		else
+			proc_table[p->p_sendto].q_sending = p->next_sending;
+		p->next_sending = 0;
+	}
+
+	p->p_flags = HANGING;
+	p->p_msg = 0;
+	p->p_recvfrom = NO_TASK;
+	p->p_sendto = NO_TASK;
+
+	enable_int();
+}
+
 /*****************************************************************************
  *                                inform_int
  *****************************************************************************/
@@ -0,0 +1,50 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   copyrange.c
+ * @brief  copy_range()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                copy_range
+ *****************************************************************************/
+/**
+ * Copy bytes from one file to another, or within a file, inside FS. The
+ * ranges may overlap. The file offsets are not changed.
+ * 
+ * @param fd_in    The source.
+ * @param off_in   Where the bytes are.
+ * @param fd_out   The destination, which may be fd_in.
+ * @param off_out  Where they go, not beyond the end of fd_out. The file
+ *                 grows if needed.
+ * @param len      How many bytes.
+ * 
+ * @return  The number of bytes copied, which is less than `len' if the
+ *          source ends before. On error, -1 is returned.
+ *****************************************************************************/
+PUBLIC int copy_range(int fd_in, int off_in, int fd_out, int off_out, int len)
+{
+	MESSAGE msg;
+	msg.type         = COPY_RANGE;
+	msg.FD           = fd_in;
+	msg.POSITION     = off_in;
+	msg.FD_OUT       = fd_out;
+	msg.POSITION_OUT = off_out;
+	msg.CNT          = len;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.CNT;
+}
@@ -0,0 +1,67 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   futex.c
+ * @brief  futex_wait(), futex_wake()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                futex_wait
+ *****************************************************************************/
+/**
+ * Block until futex_wake() is called on addr, provided that *addr still
+ * equals val when MM looks at it.
+ * 
+ * @param addr  The futex.
+ * @param val   The value *addr is expected to hold.
+ * 
+ * @return  Zero if woken up, -1 if *addr != val.
+ *****************************************************************************/
+PUBLIC int futex_wait(int * addr, int val)
+{
+	MESSAGE msg;
+	msg.type	= FUTEX_WAIT;
+	msg.BUF		= (void*)addr;
+	msg.CNT		= val;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                futex_wake
+ *****************************************************************************/
+/**
+ * Wake up procs blocked in futex_wait() on addr.
+ * 
+ * @param addr  The futex.
+ * @param nr    At most how many procs to wake up.
+ * 
+ * @return  How many procs are woken up.
+ *****************************************************************************/
+PUBLIC int futex_wake(int * addr, int nr)
+{
+	MESSAGE msg;
+	msg.type	= FUTEX_WAKE;
+	msg.BUF		= (void*)addr;
+	msg.CNT		= nr;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
@@ -0,0 +1,36 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   getticks.c
+ * @brief  get_ticks()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+
+/*****************************************************************************
+ *                                get_ticks
+ *****************************************************************************/
+/**
+ * Get the clock ticks since boot, HZ per second.
+ * 
+ * @return The ticks.
+ *****************************************************************************/
+PUBLIC int get_ticks()
+{
+	MESSAGE msg;
+	reset_msg(&msg);
+	msg.type = GET_TICKS;
+	send_recv(BOTH, TASK_SYS, &msg);
+	return msg.RETVAL;
+}
@@ -0,0 +1,534 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   hash.c
+ * @brief  Keyed hash functions: HMAC-MD5 and BLAKE2s.
+ *
+ * Callers go through struct hash_alg, so FS can pick one in config.h (see
+ * CHECKSUM_HASH) and `hashbench' can time them all.
+ *
+ * Both block functions take as many whole blocks as the caller has in one
+ * call, straight from the caller's buffer, and read the message as 32-bit
+ * little-endian words (which is how the x86 stores them anyway); only an
+ * unaligned block is copied first.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "string.h"
+#include "hash.h"
+
+PRIVATE void	md5_blocks(struct md5_state * s, const u8 * p, int nr);
+PRIVATE void	md5_start(struct md5_state * s);
+PRIVATE void	md5_add(struct md5_state * s, const u8 * p, int len);
+PRIVATE void	md5_end(struct md5_state * s, u8 digest[16]);
+PRIVATE void	blake2s_blocks(struct blake2s_state * s, const u8 * p, int nr,
+			       int last);
+
+PRIVATE void	hmac_md5_init(HASH_CTX * ctx, const u8 * key, int keylen,
+			      int outlen);
+PRIVATE void	hmac_md5_update(HASH_CTX * ctx, const u8 * p, int len);
+PRIVATE void	hmac_md5_final(HASH_CTX * ctx, u8 * digest);
+PRIVATE void	blake2s_init(HASH_CTX * ctx, const u8 * key, int keylen,
+			     int outlen);
+PRIVATE void	blake2s_update(HASH_CTX * ctx, const u8 * p, int len);
+PRIVATE void	blake2s_final(HASH_CTX * ctx, u8 * digest);
+
+PUBLIC const struct hash_alg hmac_md5_alg = {
+	"hmac-md5", 16, hmac_md5_init, hmac_md5_update, hmac_md5_final
+};
+
+PUBLIC const struct hash_alg blake2s_alg = {
+	"blake2s", 32, blake2s_init, blake2s_update, blake2s_final
+};
+
+PRIVATE const struct hash_alg * hash_algs[] = {
+	&hmac_md5_alg,
+	&blake2s_alg,
+	0
+};
+
+#define	ROTR32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+/*****************************************************************************
+ *                                hash_find
+ *****************************************************************************/
+/**
+ * Look a hash function up by name.
+ * 
+ * @param name  E.g. "blake2s".
+ * 
+ * @return The function, or 0 if there is no such one.
+ *****************************************************************************/
+PUBLIC const struct hash_alg * hash_find(const char * name)
+{
+	int i;
+	for (i = 0; hash_algs[i]; i++)
+		if (strcmp(hash_algs[i]->name, name) == 0)
+			return hash_algs[i];
+	return 0;
+}
+
+/*****************************************************************************
+ *                                hash_init
+ *****************************************************************************/
+/**
+ * Start a keyed hash.
+ * 
+ * @param ctx     The hash being computed.
+ * @param alg     Which function.
+ * @param key     The key, may be 0 if `keylen' is 0.
+ * @param keylen  At most HASH_MAX_KEY bytes.
+ * @param outlen  Bytes of the digest, 1 ~ alg->max_digest.
+ *****************************************************************************/
+PUBLIC void hash_init(HASH_CTX * ctx, const struct hash_alg * alg,
+		      const u8 * key, int keylen, int outlen)
+{
+	assert(keylen >= 0 && keylen <= HASH_MAX_KEY);
+	assert(outlen > 0 && outlen <= alg->max_digest);
+
+	ctx->alg = alg;
+	alg->init(ctx, key, keylen, outlen);
+}
+
+/*****************************************************************************
+ *                                hash_update
+ *****************************************************************************/
+/**
+ * Hash some more bytes.
+ * 
+ * @param ctx  The hash being computed.
+ * @param p    The bytes.
+ * @param len  How many.
+ *****************************************************************************/
+PUBLIC void hash_update(HASH_CTX * ctx, const void * p, int len)
+{
+	if (len > 0)
+		ctx->alg->update(ctx, (const u8 *)p, len);
+}
+
+/*****************************************************************************
+ *                                hash_final
+ *****************************************************************************/
+/**
+ * Finish a hash. The context is wiped, it holds the key.
+ * 
+ * @param ctx     The hash being computed.
+ * @param digest  `outlen' bytes given to hash_init() go here.
+ *****************************************************************************/
+PUBLIC void hash_final(HASH_CTX * ctx, u8 * digest)
+{
+	ctx->alg->final(ctx, digest);
+	memset(ctx, 0, sizeof(HASH_CTX));
+}
+
+/*======================================================================*
+                                  MD5
+ *======================================================================*/
+
+#define S11 7
+#define S12 12
+#define S13 17
+#define S14 22
+#define S21 5
+#define S22 9
+#define S23 14
+#define S24 20
+#define S31 4
+#define S32 11
+#define S33 16
+#define S34 23
+#define S41 6
+#define S42 10
+#define S43 15
+#define S44 21
+
+#define F(x, y, z) (((x) & (y)) | ((~x) & (z)))
+#define G(x, y, z) (((x) & (z)) | ((y) & (~z)))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+#define I(x, y, z) ((y) ^ ((x) | (~z)))
+#define ROTATE_LEFT(x, n) (((x) << (n)) | ((x) >> (32-(n))))
+
+#define FF(a, b, c, d, x, s, ac) { \
+	(a) += F((b), (c), (d)) + (x) + (u32)(ac); \
+	(a) = ROTATE_LEFT((a), (s)); \
+	(a) += (b); \
+}
+#define GG(a, b, c, d, x, s, ac) { \
+	(a) += G((b), (c), (d)) + (x) + (u32)(ac); \
+	(a) = ROTATE_LEFT((a), (s)); \
+	(a) += (b); \
+}
+#define HH(a, b, c, d, x, s, ac) { \
+	(a) += H((b), (c), (d)) + (x) + (u32)(ac); \
+	(a) = ROTATE_LEFT((a), (s)); \
+	(a) += (b); \
+}
+#define II(a, b, c, d, x, s, ac) { \
+	(a) += I((b), (c), (d)) + (x) + (u32)(ac); \
+	(a) = ROTATE_LEFT((a), (s)); \
+	(a) += (b); \
+}
+
+PRIVATE u8 md5_padding[HASH_BLOCK_SIZE] = { 0x80 };
+
+/*****************************************************************************
+ *                                md5_blocks
+ *****************************************************************************/
+/**
+ * Run the MD5 compression function over `nr' 64-byte blocks.
+ * 
+ *****************************************************************************/
+PRIVATE void md5_blocks(struct md5_state * s, const u8 * p, int nr)
+{
+	u32 aligned[16];
+
+	for (; nr > 0; nr--, p += HASH_BLOCK_SIZE) {
+		const u32 * x = (const u32 *)p;
+		if ((u32)p & 3) {
+			memcpy(aligned, (void *)p, HASH_BLOCK_SIZE);
+			x = aligned;
+		}
+
+		u32 a = s->state[0], b = s->state[1];
+		u32 c = s->state[2], d = s->state[3];
+
+		FF(a, b, c, d, x[ 0], S11, 0xd76aa478);
+		FF(d, a, b, c, x[ 1], S12, 0xe8c7b756);
+		FF(c, d, a, b, x[ 2], S13, 0x242070db);
+		FF(b, c, d, a, x[ 3], S14, 0xc1bdceee);
+		FF(a, b, c, d, x[ 4], S11, 0xf57c0faf);
+		FF(d, a, b, c, x[ 5], S12, 0x4787c62a);
+		FF(c, d, a, b, x[ 6], S13, 0xa8304613);
+		FF(b, c, d, a, x[ 7], S14, 0xfd469501);
+		FF(a, b, c, d, x[ 8], S11, 0x698098d8);
+		FF(d, a, b, c, x[ 9], S12, 0x8b44f7af);
+		FF(c, d, a, b, x[10], S13, 0xffff5bb1);
+		FF(b, c, d, a, x[11], S14, 0x895cd7be);
+		FF(a, b, c, d, x[12], S11, 0x6b901122);
+		FF(d, a, b, c, x[13], S12, 0xfd987193);
+		FF(c, d, a, b, x[14], S13, 0xa679438e);
+		FF(b, c, d, a, x[15], S14, 0x49b40821);
+
+		GG(a, b, c, d, x[ 1], S21, 0xf61e2562);
+		GG(d, a, b, c, x[ 6], S22, 0xc040b340);
+		GG(c, d, a, b, x[11], S23, 0x265e5a51);
+		GG(b, c, d, a, x[ 0], S24, 0xe9b6c7aa);
+		GG(a, b, c, d, x[ 5], S21, 0xd62f105d);
+		GG(d, a, b, c, x[10], S22, 0x02441453);
+		GG(c, d, a, b, x[15], S23, 0xd8a1e681);
+		GG(b, c, d, a, x[ 4], S24, 0xe7d3fbc8);
+		GG(a, b, c, d, x[ 9], S21, 0x21e1cde6);
+		GG(d, a, b, c, x[14], S22, 0xc33707d6);
+		GG(c, d, a, b, x[ 3], S23, 0xf4d50d87);
+		GG(b, c, d, a, x[ 8], S24, 0x455a14ed);
+		GG(a, b, c, d, x[13], S21, 0xa9e3e905);
+		GG(d, a, b, c, x[ 2], S22, 0xfcefa3f8);
+		GG(c, d, a, b, x[ 7], S23, 0x676f02d9);
+		GG(b, c, d, a, x[12], S24, 0x8d2a4c8a);
+
+		HH(a, b, c, d, x[ 5], S31, 0xfffa3942);
+		HH(d, a, b, c, x[ 8], S32, 0x8771f681);
+		HH(c, d, a, b, x[11], S33, 0x6d9d6122);
+		HH(b, c, d, a, x[14], S34, 0xfde5380c);
+		HH(a, b, c, d, x[ 1], S31, 0xa4beea44);
+		HH(d, a, b, c, x[ 4], S32, 0x4bdecfa9);
+		HH(c, d, a, b, x[ 7], S33, 0xf6bb4b60);
+		HH(b, c, d, a, x[10], S34, 0xbebfbc70);
+		HH(a, b, c, d, x[13], S31, 0x289b7ec6);
+		HH(d, a, b, c, x[ 0], S32, 0xeaa127fa);
+		HH(c, d, a, b, x[ 3], S33, 0xd4ef3085);
+		HH(b, c, d, a, x[ 6], S34, 0x04881d05);
+		HH(a, b, c, d, x[ 9], S31, 0xd9d4d039);
+		HH(d, a, b, c, x[12], S32, 0xe6db99e5);
+		HH(c, d, a, b, x[15], S33, 0x1fa27cf8);
+		HH(b, c, d, a, x[ 2], S34, 0xc4ac5665);
+
+		II(a, b, c, d, x[ 0], S41, 0xf4292244);
+		II(d, a, b, c, x[ 7], S42, 0x432aff97);
+		II(c, d, a, b, x[14], S43, 0xab9423a7);
+		II(b, c, d, a, x[ 5], S44, 0xfc93a039);
+		II(a, b, c, d, x[12], S41, 0x655b59c3);
+		II(d, a, b, c, x[ 3], S42, 0x8f0ccc92);
+		II(c, d, a, b, x[10], S43, 0xffeff47d);
+		II(b, c, d, a, x[ 1], S44, 0x85845dd1);
+		II(a, b, c, d, x[ 8], S41, 0x6fa87e4f);
+		II(d, a, b, c, x[15], S42, 0xfe2ce6e0);
+		II(c, d, a, b, x[ 6], S43, 0xa3014314);
+		II(b, c, d, a, x[13], S44, 0x4e0811a1);
+		II(a, b, c, d, x[ 4], S41, 0xf7537e82);
+		II(d, a, b, c, x[11], S42, 0xbd3af235);
+		II(c, d, a, b, x[ 2], S43, 0x2ad7d2bb);
+		II(b, c, d, a, x[ 9], S44, 0xeb86d391);
+
+		s->state[0] += a;
+		s->state[1] += b;
+		s->state[2] += c;
+		s->state[3] += d;
+	}
+}
+
+/*****************************************************************************
+ *                                md5_start
+ *****************************************************************************/
+PRIVATE void md5_start(struct md5_state * s)
+{
+	s->count[0] = s->count[1] = 0;
+	s->state[0] = 0x67452301;
+	s->state[1] = 0xefcdab89;
+	s->state[2] = 0x98badcfe;
+	s->state[3] = 0x10325476;
+}
+
+/*****************************************************************************
+ *                                md5_add
+ *****************************************************************************/
+PRIVATE void md5_add(struct md5_state * s, const u8 * p, int len)
+{
+	int used = s->count[0] & (HASH_BLOCK_SIZE - 1);
+
+	if ((s->count[0] += len) < (u32)len)
+		s->count[1]++;
+
+	if (used) {
+		int n = min(len, HASH_BLOCK_SIZE - used);
+		memcpy(s->buffer + used, (void *)p, n);
+		p += n;
+		len -= n;
+		if (used + n < HASH_BLOCK_SIZE)
+			return;
+		md5_blocks(s, s->buffer, 1);
+	}
+
+	md5_blocks(s, p, len / HASH_BLOCK_SIZE);
+	p += len & ~(HASH_BLOCK_SIZE - 1);
+	memcpy(s->buffer, (void *)p, len & (HASH_BLOCK_SIZE - 1));
+}
+
+/*****************************************************************************
+ *                                md5_end
+ *****************************************************************************/
+PRIVATE void md5_end(struct md5_state * s, u8 digest[16])
+{
+	u32 bits[2];
+	int used = s->count[0] & (HASH_BLOCK_SIZE - 1);
+
+	bits[0] = s->count[0] << 3;
+	bits[1] = (s->count[1] << 3) | (s->count[0] >> 29);
+
+	md5_add(s, md5_padding, used < 56 ? 56 - used : 120 - used);
+	md5_add(s, (u8 *)bits, 8);
+	memcpy(digest, s->state, 16);
+}
+
+/*****************************************************************************
+ *                                hmac_md5_init
+ *****************************************************************************/
+/**
+ * HMAC (RFC 2104): MD5((key ^ opad) || MD5((key ^ ipad) || message)).
+ * 
+ *****************************************************************************/
+PRIVATE void hmac_md5_init(HASH_CTX * ctx, const u8 * key, int keylen,
+			   int outlen)
+{
+	u8 ikey[HASH_BLOCK_SIZE];
+	int i;
+
+	memset(ikey, 0, HASH_BLOCK_SIZE);
+	memcpy(ikey, (void *)key, keylen);
+	for (i = 0; i < HASH_BLOCK_SIZE; i++) {
+		ctx->u.hmac.okey[i] = ikey[i] ^ 0x5c;
+		ikey[i] ^= 0x36;
+	}
+	ctx->u.hmac.outlen = outlen;
+
+	md5_start(&ctx->u.hmac.md5);
+	md5_add(&ctx->u.hmac.md5, ikey, HASH_BLOCK_SIZE);
+	memset(ikey, 0, HASH_BLOCK_SIZE);
+}
+
+/*****************************************************************************
+ *                                hmac_md5_update
+ *****************************************************************************/
+PRIVATE void hmac_md5_update(HASH_CTX * ctx, const u8 * p, int len)
+{
+	md5_add(&ctx->u.hmac.md5, p, len);
+}
+
+/*****************************************************************************
+ *                                hmac_md5_final
+ *****************************************************************************/
+PRIVATE void hmac_md5_final(HASH_CTX * ctx, u8 * digest)
+{
+	u8 inner[16];
+
+	md5_end(&ctx->u.hmac.md5, inner);
+
+	md5_start(&ctx->u.hmac.md5);
+	md5_add(&ctx->u.hmac.md5, ctx->u.hmac.okey, HASH_BLOCK_SIZE);
+	md5_add(&ctx->u.hmac.md5, inner, 16);
+	md5_end(&ctx->u.hmac.md5, inner);
+
+	memcpy(digest, inner, ctx->u.hmac.outlen);
+}
+
+/*======================================================================*
+                                BLAKE2s
+ *======================================================================*/
+
+PRIVATE const u32 blake2s_iv[8] = {
+	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+	0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+PRIVATE const u8 blake2s_sigma[10][16] = {
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+	{ 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+	{ 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+	{  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+	{  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+	{  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+	{ 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+	{ 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+	{  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+	{ 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 }
+};
+
+#define	B2S_G(a, b, c, d, x, y) {		\
+	v[a] += v[b] + (x); v[d] = ROTR32(v[d] ^ v[a], 16);	\
+	v[c] += v[d];       v[b] = ROTR32(v[b] ^ v[c], 12);	\
+	v[a] += v[b] + (y); v[d] = ROTR32(v[d] ^ v[a],  8);	\
+	v[c] += v[d];       v[b] = ROTR32(v[b] ^ v[c],  7);	\
+}
+
+/*****************************************************************************
+ *                                blake2s_blocks
+ *****************************************************************************/
+/**
+ * Run the BLAKE2s compression function over `nr' 64-byte blocks.
+ * 
+ * @param s         The state.
+ * @param p         The blocks.
+ * @param nr        How many.
+ * @param last      If nonzero, the last block is the final one of the
+ *                  message, with s->buflen bytes of it.
+ *****************************************************************************/
+PRIVATE void blake2s_blocks(struct blake2s_state * s, const u8 * p, int nr,
+			    int last)
+{
+	u32 aligned[16];
+	u32 v[16];
+	int i;
+
+	for (; nr > 0; nr--, p += HASH_BLOCK_SIZE) {
+		const u32 * m = (const u32 *)p;
+		if ((u32)p & 3) {
+			memcpy(aligned, (void *)p, HASH_BLOCK_SIZE);
+			m = aligned;
+		}
+
+		int inc = (nr == 1 && last) ? s->buflen : HASH_BLOCK_SIZE;
+		if ((s->t[0] += inc) < (u32)inc)
+			s->t[1]++;
+
+		for (i = 0; i < 8; i++) {
+			v[i] = s->h[i];
+			v[i + 8] = blake2s_iv[i];
+		}
+		v[12] ^= s->t[0];
+		v[13] ^= s->t[1];
+		if (nr == 1 && last)
+			v[14] = ~v[14];
+
+		for (i = 0; i < 10; i++) {
+			const u8 * z = blake2s_sigma[i];
+			B2S_G(0, 4,  8, 12, m[z[ 0]], m[z[ 1]]);
+			B2S_G(1, 5,  9, 13, m[z[ 2]], m[z[ 3]]);
+			B2S_G(2, 6, 10, 14, m[z[ 4]], m[z[ 5]]);
+			B2S_G(3, 7, 11, 15, m[z[ 6]], m[z[ 7]]);
+			B2S_G(0, 5, 10, 15, m[z[ 8]], m[z[ 9]]);
+			B2S_G(1, 6, 11, 12, m[z[10]], m[z[11]]);
+			B2S_G(2, 7,  8, 13, m[z[12]], m[z[13]]);
+			B2S_G(3, 4,  9, 14, m[z[14]], m[z[15]]);
+		}
+
+		for (i = 0; i < 8; i++)
+			s->h[i] ^= v[i] ^ v[i + 8];
+	}
+}
+
+/*****************************************************************************
+ *                                blake2s_init
+ *****************************************************************************/
+/**
+ * BLAKE2s (RFC 7693), keyed: the key, padded with zeroes, is the 1st block.
+ * 
+ *****************************************************************************/
+PRIVATE void blake2s_init(HASH_CTX * ctx, const u8 * key, int keylen,
+			  int outlen)
+{
+	struct blake2s_state * s = &ctx->u.b2s;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		s->h[i] = blake2s_iv[i];
+	s->h[0] ^= 0x01010000 ^ (keylen << 8) ^ outlen;
+	s->t[0] = s->t[1] = 0;
+	s->outlen = outlen;
+	s->buflen = 0;
+
+	memset(s->buffer, 0, HASH_BLOCK_SIZE);
+	if (keylen > 0) {
+		memcpy(s->buffer, (void *)key, keylen);
+		s->buflen = HASH_BLOCK_SIZE;
+	}
+}
+
+/*****************************************************************************
+ *                                blake2s_update
+ *****************************************************************************/
+/**
+ * The last block must be compressed with the final flag, so a full block is
+ * kept in the buffer until more bytes come.
+ * 
+ *****************************************************************************/
+PRIVATE void blake2s_update(HASH_CTX * ctx, const u8 * p, int len)
+{
+	struct blake2s_state * s = &ctx->u.b2s;
+
+	if (s->buflen + len <= HASH_BLOCK_SIZE) {
+		memcpy(s->buffer + s->buflen, (void *)p, len);
+		s->buflen += len;
+		return;
+	}
+
+	/* fill the buffer up, more bytes follow so it is not the last */
+	int n = HASH_BLOCK_SIZE - s->buflen;
+	memcpy(s->buffer + s->buflen, (void *)p, n);
+	p += n;
+	len -= n;
+	blake2s_blocks(s, s->buffer, 1, 0);
+
+	/* the whole blocks, except the last one, right from the caller */
+	int nr = (len - 1) / HASH_BLOCK_SIZE;
+	blake2s_blocks(s, p, nr, 0);
+	p += nr * HASH_BLOCK_SIZE;
+	len -= nr * HASH_BLOCK_SIZE;
+
+	memcpy(s->buffer, (void *)p, len);
+	s->buflen = len;
+}
+
+/*****************************************************************************
+ *                                blake2s_final
+ *****************************************************************************/
+PRIVATE void blake2s_final(HASH_CTX * ctx, u8 * digest)
+{
+	struct blake2s_state * s = &ctx->u.b2s;
+
+	memset(s->buffer + s->buflen, 0, HASH_BLOCK_SIZE - s->buflen);
+	blake2s_blocks(s, s->buffer, 1, 1);
+
+	memcpy(digest, s->h, s->outlen);
+}
@@ -0,0 +1,41 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   memstat.c
+ * @brief  memstat()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                memstat
+ *****************************************************************************/
+/**
+ * Get the physical memory usage from MM.
+ * 
+ * @param buf  Where the usage is put.
+ * 
+ * @return  Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int memstat(struct mem_stat *buf)
+{
+	MESSAGE msg;
+
+	msg.type = MEMSTAT;
+	msg.BUF	 = buf;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
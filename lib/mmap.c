@@ -0,0 +1,94 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mmap.c
+ * @brief  mmap(), msync(), munmap()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                mmap
+ *****************************************************************************/
+/**
+ * Map a part of a file into the caller's image. The file must be opened
+ * with O_RDWR. The mapping is shared with children forked later, and
+ * what is written to it goes back to the file by msync(), munmap(),
+ * exit() or exec() if PROT_WRITE is given. The file never grows: bytes
+ * past its end read as zeros and are not written back.
+ * 
+ * @param fd      File descriptor.
+ * @param offset  Where in the file to start, a multiple of 4096.
+ * @param len     How many bytes.
+ * @param prot    PROT_READ, PROT_WRITE.
+ * 
+ * @return  Address of the mapping if successful, otherwise 0.
+ *****************************************************************************/
+PUBLIC void * mmap(int fd, int offset, int len, int prot)
+{
+	MESSAGE msg;
+	msg.type	= MMAP;
+	msg.FD		= fd;
+	msg.POSITION	= offset;
+	msg.CNT		= len;
+	msg.MAP_PROT	= prot;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL == -1 ? 0 : (void*)msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                msync
+ *****************************************************************************/
+/**
+ * Write what has been written to a mapping back to the file.
+ * 
+ * @param addr  Address returned by mmap().
+ * 
+ * @return  Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int msync(void * addr)
+{
+	MESSAGE msg;
+	msg.type	= MSYNC;
+	msg.BUF		= addr;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                munmap
+ *****************************************************************************/
+/**
+ * Write a mapping back and remove it.
+ * 
+ * @param addr  Address returned by mmap().
+ * 
+ * @return  Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int munmap(void * addr)
+{
+	MESSAGE msg;
+	msg.type	= SHM_DT;
+	msg.BUF		= addr;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
@@ -0,0 +1,79 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   pread.c
+ * @brief  pread(), pwrite()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                pread
+ *****************************************************************************/
+/**
+ * Read from a file descriptor at a given offset. The file offset is not
+ * changed, so threads sharing the fd don't race on it.
+ * 
+ * @param fd      File descriptor.
+ * @param buf     Buffer to accept the bytes read.
+ * @param count   How many bytes to read.
+ * @param offset  Where in the file.
+ * 
+ * @return  On success, the number of bytes read are returned.
+ *          On error, -1 is returned.
+ *****************************************************************************/
+PUBLIC int pread(int fd, void *buf, int count, int offset)
+{
+	MESSAGE msg;
+	msg.type     = READ;
+	msg.FD       = fd;
+	msg.BUF      = buf;
+	msg.CNT      = count;
+	msg.POSITION = offset;
+	msg.RW_FLAGS = RW_AT;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.CNT;
+}
+
+/*****************************************************************************
+ *                                pwrite
+ *****************************************************************************/
+/**
+ * Write to a file descriptor at a given offset. The file offset is not
+ * changed. As with lseek(), the offset may not be beyond the end of the
+ * file.
+ * 
+ * @param fd      File descriptor.
+ * @param buf     Buffer including the bytes to write.
+ * @param count   How many bytes to write.
+ * @param offset  Where in the file.
+ * 
+ * @return  On success, the number of bytes written are returned.
+ *          On error, -1 is returned.
+ *****************************************************************************/
+PUBLIC int pwrite(int fd, const void *buf, int count, int offset)
+{
+	MESSAGE msg;
+	msg.type     = WRITE;
+	msg.FD       = fd;
+	msg.BUF      = (void*)buf;
+	msg.CNT      = count;
+	msg.POSITION = offset;
+	msg.RW_FLAGS = RW_AT;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.CNT;
+}
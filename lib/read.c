@@ -39,6 +39,7 @@ PUBLIC int read(int fd, void *buf, int count)
 	msg.FD   = fd;
 	msg.BUF  = buf;
 	msg.CNT  = count;
+	msg.RW_FLAGS = 0;
 
 	send_recv(BOTH, TASK_FS, &msg);
 
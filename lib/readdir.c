@@ -0,0 +1,46 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   readdir.c
+ * @brief  readdir()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                readdir
+ *****************************************************************************/
+/**
+ * Read the next entries of a directory, together with the status of their
+ * files, all in one go. Call it again until it returns 0.
+ * 
+ * @param fd   File descriptor of the directory.
+ * @param buf  Gets the entries.
+ * @param nr   Room in buf, in entries.
+ * 
+ * @return  How many entries are read, 0 at the end of the directory, -1 if
+ *          fd isn't a directory.
+ *****************************************************************************/
+PUBLIC int readdir(int fd, struct dirent *buf, int nr)
+{
+	MESSAGE msg;
+	msg.type	= READDIR;
+	msg.FD		= fd;
+	msg.BUF		= (void*)buf;
+	msg.CNT		= nr * sizeof(struct dirent);
+
+	send_recv(BOTH, TASK_FS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
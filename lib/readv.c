@@ -0,0 +1,72 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   readv.c
+ * @brief  readv(), writev()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                readv
+ *****************************************************************************/
+/**
+ * Read from a file descriptor into several buffers, in one request.
+ * 
+ * @param fd      File descriptor.
+ * @param iov     The buffers, filled in order.
+ * @param iovcnt  How many, at most IOV_MAX.
+ * 
+ * @return  On success, the number of bytes read are returned.
+ *          On error, -1 is returned.
+ *****************************************************************************/
+PUBLIC int readv(int fd, const struct iovec *iov, int iovcnt)
+{
+	MESSAGE msg;
+	msg.type     = READ;
+	msg.FD       = fd;
+	msg.BUF      = (void*)iov;
+	msg.CNT      = iovcnt;
+	msg.RW_FLAGS = RW_VEC;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.CNT;
+}
+
+/*****************************************************************************
+ *                                writev
+ *****************************************************************************/
+/**
+ * Write several buffers to a file descriptor, in one request.
+ * 
+ * @param fd      File descriptor.
+ * @param iov     The buffers, written in order.
+ * @param iovcnt  How many, at most IOV_MAX.
+ * 
+ * @return  On success, the number of bytes written are returned.
+ *          On error, -1 is returned.
+ *****************************************************************************/
+PUBLIC int writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	MESSAGE msg;
+	msg.type     = WRITE;
+	msg.FD       = fd;
+	msg.BUF      = (void*)iov;
+	msg.CNT      = iovcnt;
+	msg.RW_FLAGS = RW_VEC;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.CNT;
+}
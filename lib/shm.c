@@ -0,0 +1,88 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   shm.c
+ * @brief  shmget(), shmat(), shmdt()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                shmget
+ *****************************************************************************/
+/**
+ * Get the shared memory segment called `key', create it if there's none.
+ * A new segment is zeroed and attached to the caller at once. A segment
+ * is freed when its last attachment goes away (shmdt(), exit() or exec()).
+ * 
+ * @param key   Name of the segment, agreed by the procs sharing it.
+ * @param size  Bytes needed if the segment is to be created.
+ * 
+ * @return  ID of the segment if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int shmget(int key, int size)
+{
+	MESSAGE msg;
+	msg.type	= SHM_GET;
+	msg.SHM_KEY	= key;
+	msg.CNT		= size;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                shmat
+ *****************************************************************************/
+/**
+ * Attach a shared memory segment.
+ * 
+ * @param id  ID returned by shmget().
+ * 
+ * @return  Address of the segment if successful, otherwise 0.
+ *****************************************************************************/
+PUBLIC void * shmat(int id)
+{
+	MESSAGE msg;
+	msg.type	= SHM_AT;
+	msg.SHM_ID	= id;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL == -1 ? 0 : (void*)msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                shmdt
+ *****************************************************************************/
+/**
+ * Detach a shared memory segment.
+ * 
+ * @param addr  Address returned by shmat().
+ * 
+ * @return  Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int shmdt(void * addr)
+{
+	MESSAGE msg;
+	msg.type	= SHM_DT;
+	msg.BUF		= addr;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
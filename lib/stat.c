@@ -45,3 +45,29 @@ PUBLIC int stat(const char *path, struct stat *buf)
 
 	return msg.RETVAL;
 }
+
+/*****************************************************************************
+ *                                fstat
+ *************************************************************************//**
+ * Like stat(), for a file already opened. FS takes the i-node from the fd,
+ * so no path is walked.
+ * 
+ * @param fd  File descriptor.
+ * @param buf Gets the status.
+ * 
+ * @return  On success, zero is returned. On error, -1 is returned.
+ *****************************************************************************/
+PUBLIC int fstat(int fd, struct stat *buf)
+{
+	MESSAGE msg;
+
+	msg.type	= FSTAT;
+
+	msg.FD		= fd;
+	msg.BUF		= (void*)buf;
+
+	send_recv(BOTH, TASK_FS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
@@ -0,0 +1,54 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   sync.c
+ * @brief  sync(), fsync()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                sync
+ *****************************************************************************/
+/**
+ * Write everything cached by FS back to the disk.
+ * 
+ *****************************************************************************/
+PUBLIC void sync()
+{
+	MESSAGE msg;
+	msg.type   = SYNC;
+
+	send_recv(BOTH, TASK_FS, &msg);
+}
+
+/*****************************************************************************
+ *                                fsync
+ *****************************************************************************/
+/**
+ * Write the data and the metadata of a file back to the disk.
+ * 
+ * @param fd  File descriptor.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int fsync(int fd)
+{
+	MESSAGE msg;
+	msg.type   = FSYNC;
+	msg.FD     = fd;
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.RETVAL;
+}
@@ -10,10 +10,12 @@
 INT_VECTOR_SYS_CALL equ 0x90
 _NR_printx	    equ 0
 _NR_sendrec	    equ 1
+_NR_flush_tlb	    equ 2
 
 ; 导出符号
 global	printx
 global	sendrec
+global	flush_tlb
 
 bits 32
 [section .text]
@@ -53,3 +55,12 @@ printx:
 
 	ret
 
+; ====================================================================================
+;                          void flush_tlb();
+; ====================================================================================
+; Only for tasks (ring 1), see sys_flush_tlb().
+flush_tlb:
+	mov	eax, _NR_flush_tlb
+	int	INT_VECTOR_SYS_CALL
+
+	ret
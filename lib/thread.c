@@ -0,0 +1,71 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   thread.c
+ * @brief  thread_create()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+PRIVATE void thread_start(void (*fn)(void *), void * arg);
+
+/*****************************************************************************
+ *                                thread_create
+ *****************************************************************************/
+/**
+ * Start a thread which runs fn(arg) in the memory of the caller, sharing
+ * its file descriptors. The thread ends when fn returns or when it calls
+ * exit(). All threads end when the group leader (the proc which was
+ * fork()ed or exec()ed) exits.
+ * 
+ * @param fn          Where the thread starts.
+ * @param arg         Parameter of fn.
+ * @param stack       Lowest address of the thread's stack.
+ * @param stack_size  Size of the stack in bytes.
+ * 
+ * @return  PID of the thread if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int thread_create(void (*fn)(void *), void * arg,
+			 void * stack, int stack_size)
+{
+	/* thread_start(fn, arg) is entered as if it were called */
+	u32 * sp = (u32*)((char*)stack + stack_size);
+	*--sp = (u32)arg;
+	*--sp = (u32)fn;
+	*--sp = 0;		/* return address, never used */
+
+	MESSAGE msg;
+	msg.type	= THREAD_CREATE;
+	msg.ENTRY	= (void*)thread_start;
+	msg.STACK	= (void*)sp;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                thread_start
+ *****************************************************************************/
+/**
+ * The first frame of every thread.
+ * 
+ * @param fn   The thread function.
+ * @param arg  Parameter of fn.
+ *****************************************************************************/
+PRIVATE void thread_start(void (*fn)(void *), void * arg)
+{
+	fn(arg);
+	exit(0);
+}
@@ -39,6 +39,7 @@ PUBLIC int write(int fd, const void *buf, int count)
 	msg.FD   = fd;
 	msg.BUF  = (void*)buf;
 	msg.CNT  = count;
+	msg.RW_FLAGS = 0;
 
 	send_recv(BOTH, TASK_FS, &msg);
 
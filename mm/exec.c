@@ -57,28 +57,36 @@ PUBLIC int do_exec()
 	int src = mm_msg.source;	/* caller proc nr. */
 	assert(name_len < MAX_PATH);
 
+	/* the other threads would keep running in the old image */
+	if (thread_group_size(proc_table[src].p_tgid) > 1)
+		return -1;
+
 	char pathname[MAX_PATH];
 	phys_copy((void*)va2la(TASK_MM, pathname),
 		  (void*)va2la(src, mm_msg.PATHNAME),
 		  name_len);
 	pathname[name_len] = 0;	/* terminate the string */
 
-	/* get the file size */
-	struct stat s;
-	int ret = stat(pathname, &s);
-	if (ret != 0) {
-		printl("{MM} MM::do_exec()::stat() returns error. %s", pathname);
+	/* read the file */
+	int fd = open(pathname, O_RDWR);
+	if (fd == -1) {
+		printl("{MM} MM::do_exec()::open() returns error. %s", pathname);
 		return -1;
 	}
 
-	/* read the file */
-	int fd = open(pathname, O_RDWR);
-	if (fd == -1)
+	/* get the file size, the path needn't be walked again */
+	struct stat s;
+	if (fstat(fd, &s) != 0) {
+		close(fd);
 		return -1;
+	}
 	assert(s.st_size < MMBUF_SIZE);
 	read(fd, mmbuf, s.st_size);
 	close(fd);
 
+	/* attached segments don't survive exec() */
+	shm_exit(src);
+
 	/* overwrite the current proc image with the new one */
 	Elf32_Ehdr* elf_hdr = (Elf32_Ehdr*)(mmbuf);
 	int i;
@@ -23,6 +23,7 @@
 
 PRIVATE void cleanup(struct proc * proc);
 PRIVATE int terminate_process(int pid, int status);
+PRIVATE void release_thread(int tid);
 
 /*****************************************************************************
  *                                do_fork
@@ -50,10 +51,14 @@ PUBLIC int do_fork()
 
 	/* duplicate the process table */
 	int pid = mm_msg.source;
+	int tgid = proc_table[pid].p_tgid;
 	u16 child_ldt_sel = p->ldt_sel;
 	*p = proc_table[pid];
 	p->ldt_sel = child_ldt_sel;
-	p->p_parent = pid;
+	/* a child forked by a thread belongs to the group leader */
+	p->p_parent = tgid;
+	p->p_tgid = child_pid;
+	memcpy(p->filp, proc_table[tgid].filp, sizeof(p->filp));
 	sprintf(p->name, "%s_%d", proc_table[pid].name, child_pid);
 
 	/* duplicate the process: T, D & S */
@@ -103,6 +108,9 @@ PUBLIC int do_fork()
 	/* child is a copy of the parent */
 	phys_copy((void*)child_base, (void*)caller_T_base, caller_T_size);
 
+	/* the child shares the segments its parent has attached */
+	shm_fork(tgid, child_pid);
+
 	/* child's LDT */
 	init_desc(&p->ldts[INDEX_LDT_C],
 		  child_base,
@@ -138,6 +146,9 @@ PUBLIC int do_fork()
 /**
  * Perform the exit() syscall.
  *
+ * If A is a thread, only its proc_table[] slot is released. If A leads a
+ * thread group, its threads are released first, then A goes on as below.
+ *
  * If proc A calls exit(), then MM will do the following in this routine:
  *     <1> inform FS so that the fd-related things will be cleaned up
  *     <2> free A's memory
@@ -231,12 +242,28 @@ PRIVATE int terminate_process(int pid, int status)
 	int parent_pid = proc_table[pid].p_parent;
 	struct proc * p = &proc_table[pid];
 
+	/* a thread owns nothing but its proc_table[] slot */
+	if (p->p_tgid != pid) {
+		release_thread(pid);
+		return 0;
+	}
+
+	/* the threads die with their group leader */
+	for (i = 0; i < NR_TASKS + NR_PROCS; i++) {
+		if (i != pid && proc_table[i].p_flags != FREE_SLOT &&
+		    proc_table[i].p_tgid == pid)
+			release_thread(i);
+	}
+	ipc_cancel(p);
+	futex_cancel(pid);
+
 	/* tell FS, see fs_exit() */
 	MESSAGE msg2fs;
 	msg2fs.type = EXIT;
 	msg2fs.PID = pid;
 	send_recv(BOTH, TASK_FS, &msg2fs);
 
+	shm_exit(pid);
 	free_mem(pid);
 
 	p->exit_status = status;
@@ -264,6 +291,32 @@ PRIVATE int terminate_process(int pid, int status)
 	return 0;
 }
 
+/*****************************************************************************
+ *                              release_thread
+ *****************************************************************************/
+/**
+ * Release the proc_table[] slot of a thread, which may be blocked anywhere
+ * in the IPC, e.g. queued on FS or waiting for the reply to a READ.
+ *
+ * The slot stays HANGING until FS has forgotten the thread, so it can't be
+ * taken by a new proc while a reply may still be sent to it.
+ * 
+ * @param tid  PID of the thread.
+ *****************************************************************************/
+PRIVATE void release_thread(int tid)
+{
+	ipc_cancel(&proc_table[tid]);
+	futex_cancel(tid);
+
+	/* tell FS, see fs_exit() */
+	MESSAGE msg2fs;
+	msg2fs.type = EXIT;
+	msg2fs.PID = tid;
+	send_recv(BOTH, TASK_FS, &msg2fs);
+
+	proc_table[tid].p_flags = FREE_SLOT;
+}
+
 /*****************************************************************************
  *                                do_wait
  *****************************************************************************/
@@ -291,7 +344,7 @@ PUBLIC void do_wait()
 	int children = 0;
 	struct proc* p_proc = proc_table;
 	for (i = 0; i < NR_TASKS + NR_PROCS; i++,p_proc++) {
-		if (p_proc->p_parent == pid) {
+		if (p_proc->p_parent == pid && p_proc->p_tgid == i) {
 			children++;
 			if (p_proc->p_flags & HANGING) {
 				cleanup(p_proc);
@@ -25,6 +25,7 @@
 PUBLIC void do_fork_test();
 
 PRIVATE void init_mm();
+PRIVATE int  do_memstat();
 
 /*****************************************************************************
  *                                task_mm
@@ -67,6 +68,43 @@ PUBLIC void task_mm()
 			mm_msg.RETVAL = do_kill();
 			log_mm_event(KILL, src, mm_msg.RETVAL);
 			break;
+		case MEMSTAT:
+			mm_msg.RETVAL = do_memstat();
+			log_mm_event(MEMSTAT, src, mm_msg.RETVAL);
+			break;
+		case THREAD_CREATE:
+			mm_msg.RETVAL = do_thread_create();
+			log_mm_event(THREAD_CREATE, src, mm_msg.RETVAL);
+			break;
+		case FUTEX_WAIT:
+			log_mm_event(FUTEX_WAIT, src, -1);
+			do_futex_wait();
+			reply = 0;
+			break;
+		case FUTEX_WAKE:
+			mm_msg.RETVAL = do_futex_wake();
+			log_mm_event(FUTEX_WAKE, src, mm_msg.RETVAL);
+			break;
+		case SHM_GET:
+			mm_msg.RETVAL = do_shmget();
+			log_mm_event(SHM_GET, src, mm_msg.RETVAL);
+			break;
+		case SHM_AT:
+			mm_msg.RETVAL = do_shmat();
+			log_mm_event(SHM_AT, src, mm_msg.RETVAL);
+			break;
+		case SHM_DT:
+			mm_msg.RETVAL = do_shmdt();
+			log_mm_event(SHM_DT, src, mm_msg.RETVAL);
+			break;
+		case MMAP:
+			mm_msg.RETVAL = do_mmap();
+			log_mm_event(MMAP, src, mm_msg.RETVAL);
+			break;
+		case MSYNC:
+			mm_msg.RETVAL = do_msync();
+			log_mm_event(MSYNC, src, mm_msg.RETVAL);
+			break;
 		default:
 			dump_msg("MM::unknown msg", &mm_msg);
 			log_mm_event(msgtype, src, -1);
@@ -86,17 +124,20 @@ PUBLIC void task_mm()
  *****************************************************************************/
 /**
  * Do some initialization work.
+ *
+ * mem_map[] has been built by init_mem() before any task runs.
  * 
  *****************************************************************************/
 PRIVATE void init_mm()
 {
-	struct boot_params bp;
-	get_boot_params(&bp);
-
-	memory_size = bp.mem_size;
-
 	/* print memory size */
-	printl("{MM} memsize:%dMB\n", memory_size / (1024 * 1024));
+	int usable = memory_size;
+	int i;
+	for (i = 0; i < nr_mem_regions; i++)
+		if (mem_map[i].owner == MEM_OWNER_NONE)
+			usable -= mem_map[i].size;
+	printl("{MM} memsize:%dMB usable:%dMB\n",
+	       memory_size / (1024 * 1024), usable / (1024 * 1024));
 }
 
 /*****************************************************************************
@@ -104,6 +145,9 @@ PRIVATE void init_mm()
  *****************************************************************************/
 /**
  * Allocate a memory block for a proc.
+ *
+ * A proc always gets a whole PROC_IMAGE_SIZE_DEFAULT block since its LDT
+ * descriptors cover that much, even if `memsize' is smaller.
  * 
  * @param pid  Which proc the memory is for.
  * @param memsize  How many bytes is needed.
@@ -120,10 +164,8 @@ PUBLIC int alloc_mem(int pid, int memsize)
 		      PROC_IMAGE_SIZE_DEFAULT);
 	}
 
-	int base = PROCS_BASE +
-		(pid - (NR_TASKS + NR_NATIVE_PROCS)) * PROC_IMAGE_SIZE_DEFAULT;
-
-	if (base + memsize >= memory_size)
+	int base = carve_mem(PROC_IMAGE_SIZE_DEFAULT, pid, proc_table[pid].name);
+	if (base == -1)
 		panic("memory allocation failed. pid:%d", pid);
 
 	return base;
@@ -133,10 +175,8 @@ PUBLIC int alloc_mem(int pid, int memsize)
  *                                free_mem
  *****************************************************************************/
 /**
- * Free a memory block. Because a memory block is corresponding with a PID, so
- * we don't need to really `free' anything. In another word, a memory block is
- * dedicated to one and only one PID, no matter what proc actually uses this
- * PID.
+ * Free the memory blocks of a proc, so that they can be reused by any
+ * proc forked later.
  * 
  * @param pid  Whose memory is to be freed.
  * 
@@ -144,5 +184,59 @@ PUBLIC int alloc_mem(int pid, int memsize)
  *****************************************************************************/
 PUBLIC int free_mem(int pid)
 {
+	release_mem(pid);
+	return 0;
+}
+
+/*****************************************************************************
+ *                                do_memstat
+ *****************************************************************************/
+/**
+ * Perform the memstat() syscall: copy the memory usage and the counters of
+ * the buffer cache into the caller's struct mem_stat.
+ * 
+ * @return  Zero if success.
+ *****************************************************************************/
+PRIVATE int do_memstat()
+{
+	int src = mm_msg.source;
+	struct mem_stat * st = (struct mem_stat *)mmbuf;
+
+	memset(st, 0, sizeof(*st));
+	st->total = memory_size;
+
+	int i;
+	for (i = 0; i < nr_mem_regions; i++) {
+		struct mem_region * r = &mem_map[i];
+		if (r->owner == MEM_OWNER_NONE)
+			st->total -= r->size;
+		else
+			st->used += r->size;
+		if (st->nr_regions == MAX_MEM_INFO)
+			continue;
+
+		struct mem_info * mi = &st->regions[st->nr_regions++];
+		mi->base = r->base;
+		mi->size = r->size;
+		mi->owner = r->owner;
+		/* a proc may have exec'ed something else since alloc_mem() */
+		const char * name = r->owner >= NR_TASKS + NR_NATIVE_PROCS ?
+			proc_table[r->owner].name : r->name;
+		int len = strlen(name);
+		if (len >= PROC_NAME_LEN)
+			len = PROC_NAME_LEN - 1;
+		memcpy(mi->name, (void*)name, len);
+		mi->name[len] = 0;
+	}
+
+	/* FS's buffer cache lives in RAM as well */
+	int hits, misses, writes;
+	bcache_stat(&hits, &misses, &writes);
+	st->bc_hits = hits;
+	st->bc_misses = misses;
+	st->bc_writes = writes;
+
+	phys_copy(va2la(src, mm_msg.BUF), va2la(TASK_MM, st), sizeof(*st));
+
 	return 0;
 }
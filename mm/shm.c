@@ -0,0 +1,484 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mm/shm.c
+ * @brief  Shared memory segments and mapped files.
+ *
+ * A segment is a bunch of frames carved out of free RAM. To attach it, MM
+ * points the page table entries of some pages inside SHM_WINDOW_BASE ~
+ * SHM_WINDOW_BASE + SHM_WINDOW_SIZE of the caller's image to those frames.
+ * Since every linear address belongs to one proc only, the global page
+ * tables are enough, and the frames which were behind those pages stay
+ * with the proc, unused until it detaches.
+ *
+ * A segment is freed when its last attachment goes away. Procs signal each
+ * other through futex_wait()/futex_wake() on an int inside the segment.
+ *
+ * mmap() makes a segment too, filled with a range of a file by FS (see
+ * fs/mmap.c). It is shared with forked children like any other, but not
+ * found by shmget(), and every mmap() call makes a new one. The dirty bits
+ * of the page table entries tell which pages have been written; those are
+ * written back to the file by msync(), and when an attachment goes away
+ * (munmap(), exit() or exec()). Nothing stops a write to a mapping without
+ * PROT_WRITE, it is just never written back.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+
+/**
+ * @struct shm_seg
+ * @brief  A shared memory segment.
+ */
+PRIVATE struct shm_seg {
+	int	key;		/**< chosen by the user */
+	int	base;		/**< physical address, page aligned */
+	int	size;		/**< in bytes, a multiple of 4096 */
+	int	nattach;	/**< 0 if the slot is free */
+	int	fmap;		/**< FS handle of the mapped file, -1 if none */
+	int	fpos;		/**< where in the file the mapping starts */
+	int	flen;		/**< bytes of the file mapped */
+	int	prot;		/**< PROT_READ, PROT_WRITE */
+} shm_table[NR_SHM];
+
+/**
+ * @struct shm_attach
+ * @brief  Where a segment is attached in a proc image.
+ */
+PRIVATE struct shm_attach {
+	int	pid;		/**< group leader, 0 (TTY) if the slot is free */
+	int	id;		/**< index of shm_table[] */
+	u32	va;		/**< offset in the proc image */
+} shm_attach_table[NR_SHM_ATTACH];
+
+PRIVATE int  attach(int pid, int id, u32 va);
+PRIVATE void detach(struct shm_attach * a);
+PRIVATE u32  find_window(int pid, int size);
+PRIVATE void writeback(struct shm_seg * seg, struct shm_attach * a);
+PRIVATE int  fmap_msg(int type, struct shm_seg * seg, int off, int cnt);
+
+/*****************************************************************************
+ *                                do_shmget
+ *****************************************************************************/
+/**
+ * Perform the shmget() syscall: find the segment called mm_msg.SHM_KEY, or
+ * create one with mm_msg.CNT bytes if there's none. A new segment is
+ * attached to the caller right away.
+ * 
+ * @return  ID of the segment if success, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_shmget()
+{
+	int key = mm_msg.SHM_KEY;
+	int size = (mm_msg.CNT + 4095) & ~4095;
+	int i;
+
+	for (i = 0; i < NR_SHM; i++)
+		if (shm_table[i].nattach && shm_table[i].fmap == -1 &&
+		    shm_table[i].key == key)
+			return i;
+
+	if (size <= 0 || size > SHM_WINDOW_SIZE)
+		return -1;
+
+	for (i = 0; i < NR_SHM; i++)
+		if (shm_table[i].nattach == 0)
+			break;
+	if (i == NR_SHM)
+		return -1;
+
+	int base = carve_mem(size, MEM_OWNER_SHM, "shm");
+	if (base == -1)
+		return -1;
+	phys_set((void*)base, 0, size);
+
+	struct shm_seg * seg = &shm_table[i];
+	seg->key = key;
+	seg->base = base;
+	seg->size = size;
+	seg->nattach = 0;
+	seg->fmap = -1;
+
+	/* the creator has it attached, or it would be freed at once */
+	if (attach(proc_table[mm_msg.source].p_tgid, i, 0) == -1) {
+		release_mem_at(base);
+		return -1;
+	}
+
+	return i;
+}
+
+/*****************************************************************************
+ *                                do_shmat
+ *****************************************************************************/
+/**
+ * Perform the shmat() syscall.
+ * 
+ * @return  Where the segment mm_msg.SHM_ID is attached in the caller's
+ *          image, or -1 if failed.
+ *****************************************************************************/
+PUBLIC int do_shmat()
+{
+	int id = mm_msg.SHM_ID;
+	if (id < 0 || id >= NR_SHM || shm_table[id].nattach == 0)
+		return -1;
+
+	int pid = proc_table[mm_msg.source].p_tgid;
+
+	/* shmget() has already attached it for the creator */
+	int i;
+	for (i = 0; i < NR_SHM_ATTACH; i++) {
+		struct shm_attach * a = &shm_attach_table[i];
+		if (a->pid == pid && a->id == id)
+			return a->va;
+	}
+
+	return attach(pid, id, 0);
+}
+
+/*****************************************************************************
+ *                                do_shmdt
+ *****************************************************************************/
+/**
+ * Perform the shmdt() syscall: detach the segment at mm_msg.BUF.
+ * 
+ * @return  Zero if success, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_shmdt()
+{
+	int pid = proc_table[mm_msg.source].p_tgid;
+	u32 va = (u32)mm_msg.BUF;
+
+	int i;
+	for (i = 0; i < NR_SHM_ATTACH; i++) {
+		struct shm_attach * a = &shm_attach_table[i];
+		if (a->pid == pid && a->va == va) {
+			detach(a);
+			flush_tlb();
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/*****************************************************************************
+ *                                do_mmap
+ *****************************************************************************/
+/**
+ * Perform the mmap() syscall: map mm_msg.CNT bytes of the file mm_msg.FD
+ * from mm_msg.POSITION, which must be page aligned.
+ * 
+ * @return  Where the file is mapped in the caller's image, or -1 if failed.
+ *****************************************************************************/
+PUBLIC int do_mmap()
+{
+	int src = mm_msg.source;
+	int pos = (int)mm_msg.POSITION;
+	int len = mm_msg.CNT;
+	int size = (len + 4095) & ~4095;
+	int i;
+
+	if (pos < 0 || (pos & 4095) || len <= 0 || size > SHM_WINDOW_SIZE)
+		return -1;
+
+	for (i = 0; i < NR_SHM; i++)
+		if (shm_table[i].nattach == 0)
+			break;
+	if (i == NR_SHM)
+		return -1;
+
+	int base = carve_mem(size, MEM_OWNER_SHM, "mmap");
+	if (base == -1)
+		return -1;
+	phys_set((void*)base, 0, size);
+
+	/* let FS fill it */
+	MESSAGE msg;
+	reset_msg(&msg);
+	msg.type	= FMAP_OPEN;
+	msg.PROC_NR	= src;
+	msg.FD		= mm_msg.FD;
+	msg.POSITION	= pos;
+	msg.CNT		= len;
+	msg.BUF		= (void*)base;
+	send_recv(BOTH, TASK_FS, &msg);
+	if (msg.RETVAL == -1) {
+		release_mem_at(base);
+		return -1;
+	}
+
+	struct shm_seg * seg = &shm_table[i];
+	seg->key = 0;
+	seg->base = base;
+	seg->size = size;
+	seg->nattach = 0;
+	seg->fmap = msg.RETVAL;
+	seg->fpos = pos;
+	seg->flen = len;
+	seg->prot = mm_msg.MAP_PROT;
+
+	int va = attach(proc_table[src].p_tgid, i, 0);
+	if (va == -1) {
+		fmap_msg(FMAP_CLOSE, seg, 0, 0);
+		release_mem_at(base);
+	}
+	return va;
+}
+
+/*****************************************************************************
+ *                                do_msync
+ *****************************************************************************/
+/**
+ * Perform the msync() syscall: write back what has been written to the
+ * mapping at mm_msg.BUF, by the caller or anybody sharing it.
+ * 
+ * @return  Zero if success, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_msync()
+{
+	int pid = proc_table[mm_msg.source].p_tgid;
+	u32 va = (u32)mm_msg.BUF;
+	int i;
+
+	for (i = 0; i < NR_SHM_ATTACH; i++) {
+		struct shm_attach * a = &shm_attach_table[i];
+		if (a->pid == pid && a->va == va)
+			break;
+	}
+	if (i == NR_SHM_ATTACH)
+		return -1;
+
+	int id = shm_attach_table[i].id;
+	struct shm_seg * seg = &shm_table[id];
+	if (seg->fmap == -1)
+		return -1;
+
+	for (i = 0; i < NR_SHM_ATTACH; i++) {
+		struct shm_attach * a = &shm_attach_table[i];
+		if (a->pid && a->id == id)
+			writeback(seg, a);
+	}
+	flush_tlb();
+	return 0;
+}
+
+/*****************************************************************************
+ *                                shm_fork
+ *****************************************************************************/
+/**
+ * A forked child gets every segment of its parent, at the same places.
+ * 
+ * @param parent  Group leader of the parent.
+ * @param child   PID of the child.
+ *****************************************************************************/
+PUBLIC void shm_fork(int parent, int child)
+{
+	int i;
+	for (i = 0; i < NR_SHM_ATTACH; i++) {
+		struct shm_attach * a = &shm_attach_table[i];
+		if (a->pid == parent && attach(child, a->id, a->va) == -1)
+			panic("shm_attach_table[] is full");
+	}
+}
+
+/*****************************************************************************
+ *                                shm_exit
+ *****************************************************************************/
+/**
+ * Detach everything from a proc image which is going away or being
+ * replaced by exec().
+ * 
+ * @param pid  Group leader.
+ *****************************************************************************/
+PUBLIC void shm_exit(int pid)
+{
+	int n = 0;
+	int i;
+	for (i = 0; i < NR_SHM_ATTACH; i++) {
+		struct shm_attach * a = &shm_attach_table[i];
+		if (a->pid == pid) {
+			detach(a);
+			n++;
+		}
+	}
+	if (n)
+		flush_tlb();
+}
+
+/*****************************************************************************
+ *                                attach
+ *****************************************************************************/
+/**
+ * Map a segment into a proc image.
+ * 
+ * @param pid  Group leader.
+ * @param id   Index of shm_table[].
+ * @param va   Where to attach it, or 0 to let MM choose.
+ * 
+ * @return  Where the segment is attached, or -1 if there's no room.
+ *****************************************************************************/
+PRIVATE int attach(int pid, int id, u32 va)
+{
+	struct shm_seg * seg = &shm_table[id];
+
+	/* tasks and native procs live in the kernel image, no window there */
+	if (pid < NR_TASKS + NR_NATIVE_PROCS)
+		return -1;
+
+	if (va == 0)
+		va = find_window(pid, seg->size);
+	if (va == 0)
+		return -1;
+
+	int i;
+	for (i = 0; i < NR_SHM_ATTACH; i++)
+		if (shm_attach_table[i].pid == 0)
+			break;
+	if (i == NR_SHM_ATTACH)
+		return -1;
+
+	struct shm_attach * a = &shm_attach_table[i];
+	a->pid = pid;
+	a->id = id;
+	a->va = va;
+	seg->nattach++;
+
+	u32 la = (u32)va2la(pid, (void*)va);
+	int off;
+	for (off = 0; off < seg->size; off += 4096) {
+		map_page(la + off, seg->base + off);
+		page_dirty(la + off);	/* left by the old frame */
+	}
+	flush_tlb();
+
+	return va;
+}
+
+/*****************************************************************************
+ *                                detach
+ *****************************************************************************/
+/**
+ * Give the pages back their own frames, and free the segment if nobody
+ * else has it. The caller flushes the TLB.
+ * 
+ * @param a  The attachment.
+ *****************************************************************************/
+PRIVATE void detach(struct shm_attach * a)
+{
+	struct shm_seg * seg = &shm_table[a->id];
+
+	/* the dirty bits go away with the mapping */
+	if (seg->fmap != -1)
+		writeback(seg, a);
+
+	u32 la = (u32)va2la(a->pid, (void*)a->va);
+	int off;
+	for (off = 0; off < seg->size; off += 4096)
+		map_page(la + off, la + off);
+
+	a->pid = 0;
+	if (--seg->nattach == 0) {
+		if (seg->fmap != -1)
+			fmap_msg(FMAP_CLOSE, seg, 0, 0);
+		release_mem_at(seg->base);
+	}
+}
+
+/*****************************************************************************
+ *                                writeback
+ *****************************************************************************/
+/**
+ * Write the pages of a mapped file which have been written through an
+ * attachment back to the file, a run of dirty pages at a time. The caller
+ * flushes the TLB.
+ * 
+ * @param seg  The mapping.
+ * @param a    The attachment.
+ *****************************************************************************/
+PRIVATE void writeback(struct shm_seg * seg, struct shm_attach * a)
+{
+	u32 la = (u32)va2la(a->pid, (void*)a->va);
+	int start = -1;
+	int off;
+
+	for (off = 0; off <= seg->size; off += 4096) {
+		int dirty = off < seg->size && page_dirty(la + off);
+		if (dirty && start == -1) {
+			start = off;
+		}
+		else if (!dirty && start != -1) {
+			int end = min(off, seg->flen);
+			if ((seg->prot & PROT_WRITE) && end > start)
+				fmap_msg(FMAP_WRITE, seg, start, end - start);
+			start = -1;
+		}
+	}
+}
+
+/*****************************************************************************
+ *                                fmap_msg
+ *****************************************************************************/
+/**
+ * Ask FS to do something about the file of a mapping.
+ * 
+ * @param type  FMAP_WRITE or FMAP_CLOSE.
+ * @param seg   The mapping.
+ * @param off   FMAP_WRITE: where in the mapping the bytes are.
+ * @param cnt   FMAP_WRITE: how many.
+ * 
+ * @return  What FS returns.
+ *****************************************************************************/
+PRIVATE int fmap_msg(int type, struct shm_seg * seg, int off, int cnt)
+{
+	MESSAGE msg;
+	reset_msg(&msg);
+	msg.type	= type;
+	msg.FD		= seg->fmap;
+	msg.POSITION	= seg->fpos + off;
+	msg.CNT		= cnt;
+	msg.BUF		= (void*)(seg->base + off);
+	send_recv(BOTH, TASK_FS, &msg);
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                find_window
+ *****************************************************************************/
+/**
+ * Find room for `size' bytes in the shm window of a proc image.
+ * 
+ * @param pid   Group leader.
+ * @param size  How many bytes.
+ * 
+ * @return  Offset in the proc image, or 0 if the window is full.
+ *****************************************************************************/
+PRIVATE u32 find_window(int pid, int size)
+{
+	u32 va = SHM_WINDOW_BASE;
+	int i;
+	while (va + size <= SHM_WINDOW_BASE + SHM_WINDOW_SIZE) {
+		for (i = 0; i < NR_SHM_ATTACH; i++) {
+			struct shm_attach * a = &shm_attach_table[i];
+			if (a->pid != pid)
+				continue;
+			u32 top = a->va + shm_table[a->id].size;
+			if (va < top && a->va < va + size) { /* overlapped */
+				va = top;
+				break;
+			}
+		}
+		if (i == NR_SHM_ATTACH)
+			return va;
+	}
+	return 0;
+}
@@ -0,0 +1,221 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mm/thread.c
+ * @brief  Threads and futexes.
+ *
+ * A thread is a proc_table[] slot whose LDT descriptors are copies of its
+ * group leader's, so they run in the same memory. FS resolves a thread's
+ * filp[] through p_tgid, so the file descriptors are shared as well.
+ *
+ * A futex is just an int in the memory of a thread group, or in a shared
+ * memory segment. FUTEX_WAIT blocks the caller (MM does not reply) as long
+ * as the int holds the expected value, FUTEX_WAKE replies to the blocked
+ * ones.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+
+/**
+ * Procs blocked in FUTEX_WAIT, oldest first. A futex is identified by
+ * the physical address of the int, so that procs which attach the same
+ * shared memory segment at different places still meet.
+ */
+PRIVATE struct {
+	int	pid;
+	u32	key;
+} futex_q[NR_PROCS];
+PRIVATE int nr_futex_q;
+
+/*****************************************************************************
+ *                                do_thread_create
+ *****************************************************************************/
+/**
+ * Perform the thread_create() syscall.
+ *
+ * The new thread starts at mm_msg.ENTRY with its esp set to mm_msg.STACK.
+ * Whatever the thread needs on its stack has been put there by the caller.
+ * 
+ * @return  PID of the new thread if success, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_thread_create()
+{
+	int src = mm_msg.source;
+	int tgid = proc_table[src].p_tgid;
+
+	/* threads of the tasks and the native procs are not supported */
+	if (tgid < NR_TASKS + NR_NATIVE_PROCS)
+		return -1;
+
+	/* find a free slot in proc_table */
+	struct proc* p = proc_table;
+	int i;
+	for (i = 0; i < NR_TASKS + NR_PROCS; i++,p++)
+		if (p->p_flags == FREE_SLOT)
+			break;
+	if (i == NR_TASKS + NR_PROCS) /* no free slot */
+		return -1;
+
+	int tid = i;
+	assert(tid >= NR_TASKS + NR_NATIVE_PROCS);
+
+	/* same segments, same scheduling parameters as the caller */
+	u16 ldt_sel = p->ldt_sel;
+	*p = proc_table[src];
+	p->ldt_sel = ldt_sel;
+	sprintf(p->name, "%s_%d", proc_table[tgid].name, tid);
+
+	p->p_tgid = tgid;
+	p->p_parent = tgid;
+	p->exit_status = 0;
+	for (i = 0; i < NR_FILES; i++)
+		p->filp[i] = 0;
+
+	/* a fresh context, no pending IPC */
+	p->p_msg = 0;
+	p->p_recvfrom = NO_TASK;
+	p->p_sendto = NO_TASK;
+	p->has_int_msg = 0;
+	p->q_sending = 0;
+	p->next_sending = 0;
+	p->queue_level = 0;
+	p->ticks = p->priority;
+
+	struct stackframe * r = &p->regs;
+	r->eax = r->ebx = r->ecx = r->edx = 0;
+	r->esi = r->edi = r->ebp = 0;
+	r->eip = (u32)mm_msg.ENTRY;
+	r->esp = (u32)mm_msg.STACK;
+
+	p->stack_low = r->esp;
+	p->stack_high = r->esp;
+
+	/* let it run */
+	p->p_flags = 0;
+
+	return tid;
+}
+
+/*****************************************************************************
+ *                                thread_group_size
+ *****************************************************************************/
+/**
+ * How many live procs share the memory of a thread group.
+ * 
+ * @param tgid  PID of the group leader.
+ * 
+ * @return  Number of procs, including the leader.
+ *****************************************************************************/
+PUBLIC int thread_group_size(int tgid)
+{
+	int n = 0;
+	int i;
+	for (i = 0; i < NR_TASKS + NR_PROCS; i++)
+		if (proc_table[i].p_flags != FREE_SLOT &&
+		    proc_table[i].p_tgid == tgid)
+			n++;
+	return n;
+}
+
+/*****************************************************************************
+ *                                do_futex_wait
+ *****************************************************************************/
+/**
+ * Perform the futex_wait() syscall.
+ *
+ * If the int at mm_msg.BUF still equals mm_msg.CNT, the caller is queued
+ * and no reply is sent until FUTEX_WAKE. Otherwise the caller gets -1 at
+ * once. Checking and queueing can't be interleaved with a FUTEX_WAKE since
+ * MM handles one message at a time.
+ * 
+ *****************************************************************************/
+PUBLIC void do_futex_wait()
+{
+	int src = mm_msg.source;
+	void * la = va2la(src, mm_msg.BUF);
+	u32 key = la2pa((u32)la);
+
+	int val;
+	phys_copy(va2la(TASK_MM, &val), la, sizeof(val));
+
+	if (val == mm_msg.CNT && nr_futex_q < NR_PROCS) {
+		futex_q[nr_futex_q].pid = src;
+		futex_q[nr_futex_q].key = key;
+		nr_futex_q++;
+		return;
+	}
+
+	MESSAGE msg;
+	msg.type = SYSCALL_RET;
+	msg.RETVAL = -1;
+	send_recv(SEND, src, &msg);
+}
+
+/*****************************************************************************
+ *                                do_futex_wake
+ *****************************************************************************/
+/**
+ * Perform the futex_wake() syscall: unblock at most mm_msg.CNT procs
+ * waiting on the int at mm_msg.BUF, oldest first.
+ * 
+ * @return  How many procs are woken up.
+ *****************************************************************************/
+PUBLIC int do_futex_wake()
+{
+	u32 key = la2pa((u32)va2la(mm_msg.source, mm_msg.BUF));
+	int max = mm_msg.CNT;
+	int woken = 0;
+
+	int i = 0;
+	while (i < nr_futex_q && woken < max) {
+		if (futex_q[i].key != key) {
+			i++;
+			continue;
+		}
+
+		MESSAGE msg;
+		msg.type = SYSCALL_RET;
+		msg.RETVAL = 0;
+		send_recv(SEND, futex_q[i].pid, &msg);
+		woken++;
+
+		int j;
+		for (j = i; j < nr_futex_q - 1; j++)
+			futex_q[j] = futex_q[j + 1];
+		nr_futex_q--;
+	}
+
+	return woken;
+}
+
+/*****************************************************************************
+ *                                futex_cancel
+ *****************************************************************************/
+/**
+ * Forget a proc which is going away while it is blocked in FUTEX_WAIT.
+ * 
+ * @param pid  The proc.
+ *****************************************************************************/
+PUBLIC void futex_cancel(int pid)
+{
+	int i;
+	for (i = 0; i < nr_futex_q; i++) {
+		if (futex_q[i].pid == pid) {
+			for (; i < nr_futex_q - 1; i++)
+				futex_q[i] = futex_q[i + 1];
+			nr_futex_q--;
+			return;
+		}
+	}
+}
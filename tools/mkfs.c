@@ -0,0 +1,361 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   tools/mkfs.c
+ * @brief  Make a populated Orange'S FS on the host.
+ *
+ * Usage: mkfs IMAGE ROOT_BASE FILE...
+ *
+ * In the partition of IMAGE which begins at sector ROOT_BASE, write the FS
+ * that mkfs() in fs/main.c makes, with every FILE already in `/' under its
+ * base name. The files needn't be packed into a tar and extracted by Init()
+ * on the first boot, and each of them is one run of sectors, as hdldr
+ * wants kernel.bin to be. The 1st sector of `/cmd.tar' is cleared, so
+ * untar() finds nothing there.
+ *
+ * The checksums are left empty. They are keyed with what
+ * generate_checksum_key() makes at boot, so they can't be computed here;
+ * FS fills them in the first time each file is executed.
+ *
+ * This runs on the host, so only the constants and the layouts are taken
+ * from the kernel headers.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+#include "const.h"
+#include "config.h"
+
+/* what fs.h and hd.h take from type.h and stdio.h */
+#define	PUBLIC
+#define	PRIVATE		static
+typedef	unsigned int	u32;
+typedef	unsigned char	u8;
+#define	IOV_MAX		16
+struct iovec {
+	void *	iov_base;
+	int	iov_len;
+};
+
+#include "fs.h"
+#include "hd.h"
+
+#define	BITS_PER_SECT	(SECTOR_SIZE * 8)
+#define	NR_RSVD_INODES	(NR_CONSOLES + 3) /* 0, `/', dev_tty0~2, cmd.tar */
+
+PRIVATE FILE *	img;
+PRIVATE u32	root_base;
+
+PRIVATE void	die(const char * fmt, ...);
+PRIVATE void	rw_abs(u32 sect, void * buf, int nr, int write);
+PRIVATE u32	part_size(u32 base);
+PRIVATE void	set_bits(u8 * map, int bit, int n);
+PRIVATE void	add_entry(u8 * dir, int slot, int inode_nr, const char * name);
+
+/*****************************************************************************
+ *                                main
+ *****************************************************************************/
+int main(int argc, char * argv[])
+{
+	int i;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s IMAGE ROOT_BASE FILE...\n", argv[0]);
+		return 1;
+	}
+	/* only the part of the i-node before i_dev is on the disk */
+	if (offsetof(struct inode, i_dev) != INODE_SIZE)
+		die("struct inode doesn't match INODE_SIZE");
+
+	img = fopen(argv[1], "r+b");
+	if (!img)
+		die("cannot open %s", argv[1]);
+	root_base = strtoul(argv[2], 0, 0);
+
+	/************************/
+	/*      super block     */
+	/************************/
+	/* the same as mkfs() */
+	struct super_block sb;
+	memset(&sb, 0, sizeof(sb));
+	sb.magic	  = MAGIC_V1;
+	sb.nr_inodes	  = BITS_PER_SECT;
+	sb.nr_inode_sects = sb.nr_inodes * INODE_SIZE / SECTOR_SIZE;
+	sb.nr_sects	  = part_size(root_base);
+	sb.nr_imap_sects  = 1;
+	sb.nr_smap_sects  = sb.nr_sects / BITS_PER_SECT + 1;
+	sb.n_1st_sect	  = 1 + 1 +   /* boot sector & super block */
+		sb.nr_imap_sects + sb.nr_smap_sects + sb.nr_inode_sects;
+	sb.root_inode	  = ROOT_INODE;
+	sb.inode_size	  = INODE_SIZE;
+	sb.inode_isize_off= offsetof(struct inode, i_size);
+	sb.inode_start_off= offsetof(struct inode, i_start_sect);
+	sb.dir_ent_size	  = DIR_ENTRY_SIZE;
+	sb.dir_ent_inode_off = offsetof(struct dir_entry, inode_nr);
+	sb.dir_ent_fname_off = offsetof(struct dir_entry, name);
+
+	if (INSTALL_START_SECT + INSTALL_NR_SECTS >=
+	    sb.nr_sects - NR_SECTS_FOR_LOG)
+		die("partition too small: 0x%x sectors", sb.nr_sects);
+
+	int nr_files = argc - 3;
+	if (NR_RSVD_INODES + nr_files > sb.nr_inodes)
+		die("too many files");
+
+	/************************/
+	/*  maps, inodes, `/'   */
+	/************************/
+	u8 * imap = calloc(sb.nr_imap_sects, SECTOR_SIZE);
+	u8 * smap = calloc(sb.nr_smap_sects, SECTOR_SIZE);
+	u8 * inodes = calloc(sb.nr_inode_sects, SECTOR_SIZE);
+	int nr_entries = NR_CONSOLES + 2 + nr_files;
+	int nr_dir_sects = (nr_entries * DIR_ENTRY_SIZE + SECTOR_SIZE - 1) /
+		SECTOR_SIZE;
+	if (nr_dir_sects > NR_DEFAULT_FILE_SECTS)
+		die("too many files");
+	u8 * dir = calloc(nr_dir_sects, SECTOR_SIZE);
+
+	set_bits(imap, 0, NR_RSVD_INODES + nr_files);
+
+	/* bit 0 is reserved, NR_DEFAULT_FILE_SECTS for `/' */
+	set_bits(smap, 0, NR_DEFAULT_FILE_SECTS + 1);
+	set_bits(smap, INSTALL_START_SECT - sb.n_1st_sect, INSTALL_NR_SECTS);
+
+	struct inode * pi = (struct inode *)inodes;
+	pi->i_mode = I_DIRECTORY;
+	pi->i_size = DIR_ENTRY_SIZE * nr_entries;
+	pi->i_start_sect = sb.n_1st_sect;
+	pi->i_nr_sects = NR_DEFAULT_FILE_SECTS;
+	add_entry(dir, 0, ROOT_INODE, ".");
+
+	char name[MAX_FILENAME_LEN + 1];
+	for (i = 0; i < NR_CONSOLES; i++) {
+		pi = (struct inode *)(inodes + INODE_SIZE * (i + 1));
+		pi->i_mode = I_CHAR_SPECIAL;
+		pi->i_start_sect = MAKE_DEV(DEV_CHAR_TTY, i);
+		sprintf(name, "dev_tty%d", i);
+		add_entry(dir, i + 1, i + 2, name);
+	}
+
+	pi = (struct inode *)(inodes + INODE_SIZE * (NR_CONSOLES + 1));
+	pi->i_mode = I_REGULAR;
+	pi->i_size = INSTALL_NR_SECTS * SECTOR_SIZE;
+	pi->i_start_sect = INSTALL_START_SECT;
+	pi->i_nr_sects = INSTALL_NR_SECTS;
+	add_entry(dir, NR_CONSOLES + 1, NR_CONSOLES + 2, "cmd.tar");
+
+	/************************/
+	/*        files         */
+	/************************/
+	/*
+	 * one after another, right after `/'. Nothing is written until all
+	 * of them are found to fit.
+	 */
+	u32 next = sb.n_1st_sect + NR_DEFAULT_FILE_SECTS + 1;
+	for (i = 0; i < nr_files; i++) {
+		const char * path = argv[3 + i];
+		const char * base = strrchr(path, '/') ? strrchr(path, '/') + 1
+						       : path;
+		int slot = NR_CONSOLES + 2 + i;
+		int inode_nr = NR_RSVD_INODES + i;
+		int j;
+
+		if (!base[0] || strlen(base) > MAX_FILENAME_LEN)
+			die("bad file name: %s", path);
+		for (j = 0; j < slot; j++) {
+			struct dir_entry * de = (struct dir_entry *)dir + j;
+			if (strncmp(de->name, base, MAX_FILENAME_LEN) == 0)
+				die("%s is already in `/'", base);
+		}
+
+		FILE * f = fopen(path, "rb");
+		if (!f)
+			die("cannot open %s", path);
+		fseek(f, 0, SEEK_END);
+		long size = ftell(f);
+		fclose(f);
+		int nr_sects = (size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+		if (next + nr_sects > INSTALL_START_SECT)
+			die("no room for %s", path);
+
+		pi = (struct inode *)(inodes + INODE_SIZE * (inode_nr - 1));
+		pi->i_mode = I_REGULAR;
+		pi->i_size = size;
+		if (nr_sects) {
+			pi->i_start_sect = next;
+			pi->i_nr_sects = nr_sects;
+			set_bits(smap, next - sb.n_1st_sect, nr_sects);
+			next += nr_sects;
+		}
+
+		add_entry(dir, slot, inode_nr, base);
+	}
+
+	for (i = 0; i < nr_files; i++) {
+		const char * path = argv[3 + i];
+		int inode_nr = NR_RSVD_INODES + i;
+
+		pi = (struct inode *)(inodes + INODE_SIZE * (inode_nr - 1));
+		int nr_sects = pi->i_nr_sects;
+		u8 * data = calloc(nr_sects + 1, SECTOR_SIZE);
+		FILE * f = fopen(path, "rb");
+		if (!f || fread(data, 1, pi->i_size, f) != pi->i_size)
+			die("cannot read %s", path);
+		fclose(f);
+		if (nr_sects)
+			rw_abs(root_base + pi->i_start_sect, data, nr_sects, 1);
+		free(data);
+
+		printf("    %-12.12s %8d bytes  inode %d\n",
+		       ((struct dir_entry *)dir)[NR_CONSOLES + 2 + i].name,
+		       pi->i_size, inode_nr);
+	}
+
+	u8 sect[SECTOR_SIZE];
+	memset(sect, 0x90, SECTOR_SIZE);
+	memcpy(sect, &sb, SUPER_BLOCK_SIZE);
+	rw_abs(root_base + 1, sect, 1, 1);
+
+	u32 s = 2;
+	rw_abs(root_base + s, imap, sb.nr_imap_sects, 1);
+	s += sb.nr_imap_sects;
+	rw_abs(root_base + s, smap, sb.nr_smap_sects, 1);
+	s += sb.nr_smap_sects;
+	rw_abs(root_base + s, inodes, sb.nr_inode_sects, 1);
+	rw_abs(root_base + sb.n_1st_sect, dir, nr_dir_sects, 1);
+
+	/* nothing to untar */
+	memset(sect, 0, SECTOR_SIZE);
+	rw_abs(root_base + INSTALL_START_SECT, sect, 1, 1);
+
+	/* whatever an old FS left there must not be replayed */
+	rw_abs(root_base + sb.nr_sects - NR_SECTS_FOR_LOG - NR_JOURNAL_SECTS,
+	       sect, 1, 1);
+
+	if (fclose(img) != 0)
+		die("cannot write %s", argv[1]);
+
+	printf("%d files, sectors 0x%x~0x%x used\n",
+	       nr_files, sb.n_1st_sect, next - 1);
+	return 0;
+}
+
+/*****************************************************************************
+ *                                die
+ *****************************************************************************/
+/**
+ * Print an error and quit.
+ *****************************************************************************/
+PRIVATE void die(const char * fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "mkfs: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	exit(1);
+}
+
+/*****************************************************************************
+ *                                rw_abs
+ *****************************************************************************/
+/**
+ * Read or write sectors of the image.
+ *
+ * @param sect   The 1st sector, from the beginning of the image.
+ * @param buf    nr * SECTOR_SIZE bytes.
+ * @param nr     How many sectors.
+ * @param write  Whether to write.
+ *****************************************************************************/
+PRIVATE void rw_abs(u32 sect, void * buf, int nr, int write)
+{
+	size_t n;
+
+	if (fseek(img, (long)sect * SECTOR_SIZE, SEEK_SET) != 0)
+		die("cannot seek to sector 0x%x", sect);
+	if (write)
+		n = fwrite(buf, SECTOR_SIZE, nr, img);
+	else
+		n = fread(buf, SECTOR_SIZE, nr, img);
+	if (n != nr)
+		die("cannot %s sector 0x%x", write ? "write" : "read", sect);
+}
+
+/*****************************************************************************
+ *                                part_size
+ *****************************************************************************/
+/**
+ * Find the partition beginning at a sector the way partition() in
+ * kernel/hd.c does, the logical ones included.
+ *
+ * @param base  The 1st sector of the partition.
+ *
+ * @return  How many sectors it has.
+ *****************************************************************************/
+PRIVATE u32 part_size(u32 base)
+{
+	u8 mbr[SECTOR_SIZE];
+	u8 ebr[SECTOR_SIZE];
+	int i, j;
+
+	rw_abs(0, mbr, 1, 0);
+	struct part_ent * prim = (struct part_ent *)(mbr +
+						     PARTITION_TABLE_OFFSET);
+
+	for (i = 0; i < NR_PART_PER_DRIVE; i++) {
+		if (prim[i].sys_id == NO_PART)
+			continue;
+		if (prim[i].start_sect == base)
+			return prim[i].nr_sects;
+		if (prim[i].sys_id != EXT_PART)
+			continue;
+
+		u32 ext_start_sect = prim[i].start_sect;
+		u32 s = ext_start_sect;
+		for (j = 0; j < NR_SUB_PER_PART; j++) {
+			rw_abs(s, ebr, 1, 0);
+			struct part_ent * log = (struct part_ent *)
+				(ebr + PARTITION_TABLE_OFFSET);
+			if (s + log[0].start_sect == base)
+				return log[0].nr_sects;
+			if (log[1].sys_id == NO_PART)
+				break;
+			s = ext_start_sect + log[1].start_sect;
+		}
+	}
+
+	die("no partition begins at sector 0x%x", base);
+	return 0;
+}
+
+/*****************************************************************************
+ *                                set_bits
+ *****************************************************************************/
+/**
+ * Mark `n' bits of a map as used, starting from bit `bit'.
+ *****************************************************************************/
+PRIVATE void set_bits(u8 * map, int bit, int n)
+{
+	for (; n > 0; n--, bit++)
+		map[bit / 8] |= 1 << (bit % 8);
+}
+
+/*****************************************************************************
+ *                                add_entry
+ *****************************************************************************/
+/**
+ * Fill a slot of `/'. The name is cut short as dir_add() does.
+ *****************************************************************************/
+PRIVATE void add_entry(u8 * dir, int slot, int inode_nr, const char * name)
+{
+	struct dir_entry * de = (struct dir_entry *)dir + slot;
+
+	de->inode_nr = inode_nr;
+	strncpy(de->name, name, MAX_FILENAME_LEN);
+}